@@ -0,0 +1,230 @@
+// Asset loading benchmark: loads every OBJ/glTF under Assets/models and every PNG/JPEG under Assets/textures
+// with Model::init and Texture::init, timing the parsing and the GPU upload separately. The uploads are not
+// batched: each one waits for the GPU, as at startup before the upload batch
+//
+// Build from the Hungry_Bird_Project folder and run it there (it needs the Assets folder):
+//   g++ -O2 -std=c++17 -Iheaders -I. Benchmarks/AssetLoadingBenchmark.cpp -o AssetLoadingBenchmark -lglfw -lvulkan
+//
+// Options:
+//   --triangles <n>   triangles of the generated grid OBJ (default 2000000, 0 = do not generate it)
+//   --keep            do not delete the generated OBJ at the end
+
+#include "MyProject.hpp"
+
+#include <filesystem>
+#include <iomanip>
+
+namespace fs = std::filesystem;
+
+const std::string GENERATED_OBJ = "GeneratedGrid.obj";
+
+// A square grid in the xz plane with texture coordinates and normals, like the exported models
+void generateGridObj(const std::string& file, size_t triangles) {
+	size_t quadsPerSide = std::max<size_t>(1, (size_t)std::sqrt(triangles / 2.0));
+	size_t verticesPerSide = quadsPerSide + 1;
+
+	std::ofstream out(file);
+	if (!out.is_open()) {
+		throw std::runtime_error("failed to create " + file + "!");
+	}
+	out << "# " << quadsPerSide * quadsPerSide * 2 << " triangles generated by AssetLoadingBenchmark\n";
+	out << std::fixed << std::setprecision(6);
+	for (size_t z = 0; z < verticesPerSide; z++) {
+		for (size_t x = 0; x < verticesPerSide; x++) {
+			float u = (float)x / quadsPerSide;
+			float v = (float)z / quadsPerSide;
+			out << "v " << u * 100.0f << " " << 0.5f * std::sin(u * 40.0f) * std::cos(v * 40.0f) << " " << v * 100.0f << "\n";
+			out << "vt " << u << " " << v << "\n";
+		}
+	}
+	out << "vn 0.000000 1.000000 0.000000\n";
+	for (size_t z = 0; z < quadsPerSide; z++) {
+		for (size_t x = 0; x < quadsPerSide; x++) {
+			// OBJ indices start from 1
+			size_t a = z * verticesPerSide + x + 1;
+			size_t b = a + 1;
+			size_t c = a + verticesPerSide;
+			size_t d = c + 1;
+			out << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << b << "/" << b << "/1\n";
+			out << "f " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+		}
+	}
+}
+
+// Amount per second, 0 when nothing was measured
+double perSecond(double amount, double ms) {
+	return ms > 0 ? amount / (ms / 1000) : 0;
+}
+
+std::vector<std::string> findFiles(const std::string& folder, std::vector<std::string> extensions) {
+	std::vector<std::string> files;
+	for (auto const& entry : fs::recursive_directory_iterator(folder)) {
+		std::string extension = entry.path().extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if (entry.is_regular_file() &&
+			std::find(extensions.begin(), extensions.end(), extension) != extensions.end()) {
+			files.push_back(entry.path().generic_string());
+		}
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+class AssetLoadingBenchmark : public BaseProject {
+public:
+	size_t triangles = 2000000;
+	bool keepGenerated = false;
+
+protected:
+	void setWindowParameters() {
+		windowWidth = 64;
+		windowHeight = 64;
+		windowTitle = "Asset loading benchmark";
+		initialBackgroundColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+		uniformBlocksInPool = 1;
+		texturesInPool = 1;
+		setsInPool = 1;
+	}
+
+	void benchmarkModels(std::vector<std::string> files) {
+		StartupProfiler* profiler = StartupProfiler::GetInstance();
+		double totalMB = 0, totalParseMs = 0, totalUploadMs = 0, totalVertexMB = 0;
+		size_t totalVertices = 0;
+
+		std::cout << "\n---------- Models ----------\n";
+		std::cout << std::setw(10) << "MB" << std::setw(12) << "vertices" << std::setw(12) << "parse ms"
+				  << std::setw(12) << "parse MB/s" << std::setw(14) << "Mvertices/s" << std::setw(12) << "upload ms"
+				  << std::setw(13) << "upload MB/s" << "  file\n";
+		for (std::string file : files) {
+			Model model;
+			model.init(this, file);
+
+			double fileMB = fs::file_size(file) / 1e6;
+			// The sizes actually uploaded: compact vertices and 16-bit indices when they are used
+			double vertexMB = ((double)model.vertexCount * model.vertexStride + (double)model.indexCount * model.indexSize()) / 1e6;
+			double parseMs = profiler->getTime(file, "OBJ parse") + profiler->getTime(file, "glTF parse");
+			double uploadMs = profiler->getTime(file, model.uploadPhase);
+			std::cout << std::fixed << std::setprecision(2)
+					  << std::setw(10) << fileMB << std::setw(12) << model.vertexCount << std::setw(12) << parseMs
+					  << std::setw(12) << perSecond(fileMB, parseMs) << std::setw(14) << perSecond(model.vertexCount / 1e6, parseMs)
+					  << std::setw(12) << uploadMs << std::setw(13) << perSecond(vertexMB, uploadMs) << "  " << file << "\n";
+
+			totalMB += fileMB;
+			totalVertexMB += vertexMB;
+			totalParseMs += parseMs;
+			totalUploadMs += uploadMs;
+			totalVertices += model.vertexCount;
+			model.cleanup();
+		}
+		std::cout << files.size() << " models, " << totalMB << " MB, " << totalVertices << " vertices\n"
+				  << "  parse:  " << totalParseMs << " ms, " << perSecond(totalMB, totalParseMs) << " MB/s, "
+				  << perSecond(totalVertices / 1e6, totalParseMs) << " Mvertices/s\n"
+				  << "  upload: " << totalUploadMs << " ms, " << perSecond(totalVertexMB, totalUploadMs) << " MB/s\n";
+	}
+
+	void benchmarkTextures(std::vector<std::string> files) {
+		StartupProfiler* profiler = StartupProfiler::GetInstance();
+		double totalMB = 0, totalPixelMB = 0, totalDecodeMs = 0, totalUploadMs = 0, totalMipMs = 0;
+
+		std::cout << "\n---------- Textures ----------\n";
+		std::cout << std::setw(10) << "MB" << std::setw(12) << "pixel MB" << std::setw(12) << "decode ms"
+				  << std::setw(13) << "decode MB/s" << std::setw(12) << "upload ms" << std::setw(13) << "upload MB/s"
+				  << std::setw(10) << "mips ms" << "  file\n";
+		for (std::string file : files) {
+			int width, height, channels;
+			if (!stbi_info(file.c_str(), &width, &height, &channels)) {
+				std::cout << "skipped " << file << ": " << stbi_failure_reason() << "\n";
+				continue;
+			}
+
+			Texture texture;
+			texture.init(this, file);
+
+			double fileMB = fs::file_size(file) / 1e6;
+			double pixelMB = width * height * 4 / 1e6;
+			double decodeMs = profiler->getTime(file, "PNG decode");
+			double uploadMs = profiler->getTime(file, "Texture upload");
+			double mipMs = profiler->getTime(file, "Mip generation");
+			std::cout << std::fixed << std::setprecision(2)
+					  << std::setw(10) << fileMB << std::setw(12) << pixelMB << std::setw(12) << decodeMs
+					  << std::setw(13) << perSecond(fileMB, decodeMs) << std::setw(12) << uploadMs
+					  << std::setw(13) << perSecond(pixelMB, uploadMs) << std::setw(10) << mipMs << "  " << file << "\n";
+
+			totalMB += fileMB;
+			totalPixelMB += pixelMB;
+			totalDecodeMs += decodeMs;
+			totalUploadMs += uploadMs;
+			totalMipMs += mipMs;
+			texture.cleanup();
+		}
+		std::cout << files.size() << " textures, " << totalMB << " MB compressed, " << totalPixelMB << " MB of pixels\n"
+				  << "  decode: " << totalDecodeMs << " ms, " << perSecond(totalMB, totalDecodeMs) << " MB/s\n"
+				  << "  upload: " << totalUploadMs << " ms, " << perSecond(totalPixelMB, totalUploadMs) << " MB/s\n"
+				  << "  mips:   " << totalMipMs << " ms\n";
+	}
+
+	// Everything is loaded here, the benchmark stops before drawing any frame
+	void localInit() {
+		// Without the upload batch every copy is submitted and waited for inside its zone, so the upload phases
+		// include the GPU work, and each asset can be destroyed as soon as it is measured
+		uploadBatch.end();
+
+		std::vector<std::string> models = findFiles("Assets/models", { ".obj", ".glb" });
+		if (triangles > 0) {
+			std::cout << "Generating " << GENERATED_OBJ << " with " << triangles << " triangles\n";
+			generateGridObj(GENERATED_OBJ, triangles);
+			models.push_back(GENERATED_OBJ);
+		}
+
+		benchmarkModels(models);
+		benchmarkTextures(findFiles("Assets/textures", { ".png", ".jpg", ".jpeg" }));
+
+		if (triangles > 0 && !keepGenerated) {
+			fs::remove(GENERATED_OBJ);
+		}
+		stopRequested = true;
+	}
+
+	void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
+	}
+
+	void updateUniformBuffer(uint32_t currentImage) {
+	}
+
+	void localCleanup() {
+	}
+};
+
+int main(int argc, char* argv[]) {
+	AssetLoadingBenchmark app;
+
+	try {
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (arg == "--triangles" && i + 1 < argc) {
+				app.triangles = std::stoul(argv[++i]);
+			}
+			else if (arg == "--keep") {
+				app.keepGenerated = true;
+			}
+			else {
+				throw std::runtime_error("unknown or incomplete option: " + arg);
+			}
+		}
+
+		// The phases of Model::init and Texture::init are measured by the startup profiler,
+		// the mesh cache and the texture containers are disabled to measure the OBJ parsing and the PNG decoding
+		StartupProfiler::GetInstance()->start("");
+		MeshCache::GetInstance()->setEnabled(false);
+		app.setCompressedTextures(false);
+		app.setHeadless(0);
+		app.run();
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
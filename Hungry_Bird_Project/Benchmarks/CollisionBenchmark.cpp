@@ -0,0 +1,168 @@
+// Collision micro-benchmark: synthetic scenes of 10, 1k, 100k and 1M hitboxes hit by random bird hitboxes
+//
+// Build from the Hungry_Bird_Project folder (no Vulkan needed):
+//   g++ -O2 -std=c++17 -Iheaders -I. Benchmarks/CollisionBenchmark.cpp -o CollisionBenchmark
+//   cl /O2 /std:c++17 /EHsc /Iheaders /I. Benchmarks\CollisionBenchmark.cpp
+//
+// Two loops are measured for every scene:
+//   scene - firstCollided over a list of objects with a virtual hasCollided, like GameMaster::handleCollision,
+//           walking over pigs (1 hitbox) and decorations (3 hitboxes) and stopping at the first hit. The tests
+//           are pigCollided and decorationCollided of HitBox.hpp, the ones of Pig and Decoration
+//   flat  - hitBoxCollided over a contiguous array of every hitbox, the lower bound without any broadphase
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <list>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "HitBox.hpp"
+
+// Same size of the hitbox of the birds
+const glm::vec3 BIRD_HALF_SIZE = glm::vec3(0.15f, 0.15f, 0.15f);
+
+class SceneObject {
+protected:
+	bool _onScreen = true;
+
+public:
+	virtual ~SceneObject() {}
+	virtual bool hasCollided(HitBox_t otherObject) = 0;
+};
+
+class BenchPig : public SceneObject {
+	HitBox_t _hitBox;
+
+public:
+	BenchPig(HitBox_t hitBox) : _hitBox(hitBox) {}
+
+	bool hasCollided(HitBox_t otherObject) override {
+		return pigCollided(_onScreen, _hitBox, otherObject);
+	}
+};
+
+class BenchDecoration : public SceneObject {
+	std::vector<HitBox_t> _hitBoxes;
+
+public:
+	BenchDecoration(std::vector<HitBox_t> hitBoxes) : _hitBoxes(hitBoxes) {}
+
+	bool hasCollided(HitBox_t otherObject) override {
+		return decorationCollided(_onScreen, _hitBoxes, otherObject);
+	}
+};
+
+HitBox_t makeBox(glm::vec3 center, glm::vec3 halfSize) {
+	HitBox_t box;
+	box.x = glm::vec2(center.x - halfSize.x, center.x + halfSize.x);
+	box.y = glm::vec2(center.y - halfSize.y, center.y + halfSize.y);
+	box.z = glm::vec2(center.z - halfSize.z, center.z + halfSize.z);
+	return box;
+}
+
+struct Scene {
+	std::list<SceneObject*> onScene;
+	std::vector<std::unique_ptr<SceneObject>> objects;
+	std::vector<HitBox_t> boxes;
+	float side;
+};
+
+// The world grows with the number of boxes so that the density, and so the hit rate, stays the same
+void buildScene(Scene& scene, size_t boxCount, std::mt19937& rng) {
+	scene.side = 20.0f * std::cbrt(boxCount / 10.0f);
+	std::uniform_real_distribution<float> position(0.0f, scene.side);
+	std::uniform_real_distribution<float> size(0.2f, 1.0f);
+
+	auto randomBox = [&]() {
+		HitBox_t box = makeBox(glm::vec3(position(rng), position(rng), position(rng)),
+							   glm::vec3(size(rng), size(rng), size(rng)));
+		scene.boxes.push_back(box);
+		return box;
+	};
+
+	size_t created = 0;
+	while (created < boxCount) {
+		if (created % 4 == 0 && boxCount - created >= 3) {
+			std::vector<HitBox_t> hitBoxes = { randomBox(), randomBox(), randomBox() };
+			scene.objects.push_back(std::make_unique<BenchDecoration>(hitBoxes));
+			created += 3;
+		} else {
+			scene.objects.push_back(std::make_unique<BenchPig>(randomBox()));
+			created++;
+		}
+		scene.onScene.push_back(scene.objects.back().get());
+	}
+}
+
+struct Result {
+	double nsPerQuery;
+	double queriesPerSecond;
+	double hitRate;
+};
+
+template <typename F>
+Result measure(const std::vector<HitBox_t>& birds, F query) {
+	size_t hits = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (const HitBox_t& bird : birds) {
+		hits += query(bird) ? 1 : 0;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Result result;
+	result.nsPerQuery = seconds * 1e9 / birds.size();
+	result.queriesPerSecond = birds.size() / seconds;
+	result.hitRate = (double)hits / birds.size();
+	return result;
+}
+
+int main() {
+	const std::vector<size_t> sizes = { 10, 1000, 100000, 1000000 };
+	// Number of box tests for every scene, the queries are divided between them
+	const double testsPerScene = 1e8;
+
+	std::mt19937 rng(42);
+
+	std::cout << std::setw(10) << "boxes" << std::setw(8) << "loop" << std::setw(12) << "queries"
+			  << std::setw(16) << "ns/query" << std::setw(16) << "queries/s" << std::setw(10) << "hits" << "\n";
+
+	for (size_t boxCount : sizes) {
+		Scene scene;
+		buildScene(scene, boxCount, rng);
+
+		size_t queries = std::clamp<size_t>((size_t)(testsPerScene / boxCount), 100, 10000000);
+		std::uniform_real_distribution<float> position(0.0f, scene.side);
+		std::vector<HitBox_t> birds(queries);
+		for (HitBox_t& bird : birds) {
+			bird = makeBox(glm::vec3(position(rng), position(rng), position(rng)), BIRD_HALF_SIZE);
+		}
+
+		Result sceneResult = measure(birds, [&](const HitBox_t& bird) {
+			return firstCollided(scene.onScene, bird) != nullptr;
+		});
+
+		Result flatResult = measure(birds, [&](const HitBox_t& bird) {
+			for (const HitBox_t& box : scene.boxes) {
+				if (hitBoxCollided(bird, box)) {
+					return true;
+				}
+			}
+			return false;
+		});
+
+		for (auto const& row : { std::make_pair("scene", sceneResult), std::make_pair("flat", flatResult) }) {
+			std::cout << std::setw(10) << boxCount << std::setw(8) << row.first << std::setw(12) << queries
+					  << std::fixed << std::setprecision(1)
+					  << std::setw(16) << row.second.nsPerQuery
+					  << std::setw(16) << std::setprecision(0) << row.second.queriesPerSecond
+					  << std::setw(9) << std::setprecision(1) << row.second.hitRate * 100 << "%\n"
+					  << std::defaultfloat;
+		}
+	}
+
+	return 0;
+}
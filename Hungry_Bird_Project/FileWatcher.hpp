@@ -0,0 +1,142 @@
+// Changes to a set of files, reported by poll() without blocking. On Linux inotify watches the folders of the
+// files (editors often replace a file instead of writing it); on the other systems the modification times
+// are compared twice per second
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+class FileWatcher {
+	// Normalized path -> path as given to watch(), which is the one returned by poll()
+	std::map<std::string, std::string> files;
+#ifdef __linux__
+	int inotify = -1;
+	// Watch descriptor -> folder
+	std::map<int, std::string> folders;
+#else
+	std::map<std::string, std::filesystem::file_time_type> times;
+	std::chrono::steady_clock::time_point lastScan;
+#endif
+
+	static std::string normalize(const std::string& file) {
+		return std::filesystem::path(file).lexically_normal().generic_string();
+	}
+
+public:
+	FileWatcher() {}
+	FileWatcher(const FileWatcher&) = delete;
+	void operator=(const FileWatcher&) = delete;
+
+	~FileWatcher() {
+		stop();
+	}
+
+	void watch(const std::string& file) {
+		std::string path = normalize(file);
+		if (!files.insert({ path, file }).second) {
+			return;
+		}
+#ifdef __linux__
+		if (inotify < 0) {
+			inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if (inotify < 0) {
+				std::cout << "failed to start inotify, files are not watched\n";
+				return;
+			}
+		}
+		std::string folder = std::filesystem::path(path).parent_path().generic_string();
+		if (folder.empty()) {
+			folder = ".";
+		}
+		for (auto const& watched : folders) {
+			if (watched.second == folder) {
+				return;
+			}
+		}
+		// Written and closed, or moved in place of the old file
+		int descriptor = inotify_add_watch(inotify, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (descriptor < 0) {
+			std::cout << "failed to watch " << folder << "\n";
+			return;
+		}
+		folders[descriptor] = folder;
+#else
+		std::error_code error;
+		times[path] = std::filesystem::last_write_time(path, error);
+#endif
+	}
+
+	// Watched files changed since the last call, each one once
+	std::vector<std::string> poll() {
+		std::set<std::string> changed;
+#ifdef __linux__
+		if (inotify < 0) {
+			return {};
+		}
+		alignas(inotify_event) char buffer[4096];
+		while (true) {
+			ssize_t length = read(inotify, buffer, sizeof(buffer));
+			if (length <= 0) {
+				break;
+			}
+			for (char* event = buffer; event < buffer + length; event += sizeof(inotify_event) + ((inotify_event*)event)->len) {
+				const inotify_event* e = (const inotify_event*)event;
+				if (e->mask & IN_Q_OVERFLOW) {
+					// Events were lost: report everything
+					for (auto const& file : files) {
+						changed.insert(file.second);
+					}
+					continue;
+				}
+				auto folder = folders.find(e->wd);
+				if (folder == folders.end() || e->len == 0) {
+					continue;
+				}
+				auto file = files.find(normalize(folder->second + "/" + e->name));
+				if (file != files.end()) {
+					changed.insert(file->second);
+				}
+			}
+		}
+#else
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastScan < std::chrono::milliseconds(500)) {
+			return {};
+		}
+		lastScan = now;
+		for (auto& entry : times) {
+			std::error_code error;
+			std::filesystem::file_time_type time = std::filesystem::last_write_time(entry.first, error);
+			if (!error && time != entry.second) {
+				entry.second = time;
+				changed.insert(files[entry.first]);
+			}
+		}
+#endif
+		return std::vector<std::string>(changed.begin(), changed.end());
+	}
+
+	void stop() {
+#ifdef __linux__
+		if (inotify >= 0) {
+			close(inotify);
+			inotify = -1;
+		}
+		folders.clear();
+#else
+		times.clear();
+#endif
+		files.clear();
+	}
+};
@@ -0,0 +1,72 @@
+// Hitboxes and collision tests shared by the game objects and the collision benchmark
+#pragma once
+
+#include <vector>
+#include <list>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// The hitboxes are boxes placed with edges parallel to xyz axis -> we need only 6 values to save them
+typedef struct HitBox_s {
+	glm::vec2 x, y, z;
+}HitBox_t;
+
+// True if, on every axis, one of the ends of the moving box lies strictly inside the box
+inline bool hitBoxCollided(const HitBox_t& movingObject, const HitBox_t& box) {
+	bool x = false, y = false, z = false;
+
+	if ((movingObject.x[0] > box.x[0] && movingObject.x[0] < box.x[1]) || (movingObject.x[1] > box.x[0] && movingObject.x[1] < box.x[1]))
+		x = true;
+	if ((movingObject.y[0] > box.y[0] && movingObject.y[0] < box.y[1]) || (movingObject.y[1] > box.y[0] && movingObject.y[1] < box.y[1]))
+		y = true;
+	if ((movingObject.z[0] > box.z[0] && movingObject.z[0] < box.z[1]) || (movingObject.z[1] > box.z[0] && movingObject.z[1] < box.z[1]))
+		z = true;
+
+	return (x && y && z);
+}
+
+// The same box translated by offset
+inline HitBox_t moveHitBox(HitBox_t box, glm::vec3 offset) {
+	box.x += offset.x;
+	box.y += offset.y;
+	box.z += offset.z;
+	return box;
+}
+
+inline glm::vec3 hitBoxCenter(const HitBox_t& box) {
+	return glm::vec3(box.x[0] + box.x[1], box.y[0] + box.y[1], box.z[0] + box.z[1]) * 0.5f;
+}
+
+// Collision test of a pig: its only hitbox, while it is on screen
+inline bool pigCollided(bool onScreen, const HitBox_t& hitBox, const HitBox_t& movingObject) {
+	if (!onScreen) {
+		return false;
+	}
+	return hitBoxCollided(movingObject, hitBox);
+}
+
+// Collision test of a decoration: any of its hitboxes, while it is on screen
+inline bool decorationCollided(bool onScreen, const std::vector<HitBox_t>& hitBoxes, const HitBox_t& movingObject) {
+	if (!onScreen) {
+		return false;
+	}
+	for (const HitBox_t& hitBox : hitBoxes) {
+		if (hitBoxCollided(movingObject, hitBox))
+			return true;
+	}
+	return false;
+}
+
+// First object on scene hit by the moving box, like GameMaster::handleCollision (nullptr if none)
+template <typename Object>
+Object* firstCollided(const std::list<Object*>& onScene, const HitBox_t& movingObject) {
+	for (auto const& obj : onScene) {
+		if (obj->hasCollided(movingObject)) {
+			return obj;
+		}
+	}
+	return nullptr;
+}
@@ -0,0 +1,196 @@
+// Hitboxes loaded from their OBJ files: every file is read once per run, and the boxes are saved in a
+// binary collision file so the next runs do not read the OBJ files at all
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "HitBox.hpp"
+#include "MeshCache.hpp"
+
+const uint32_t HITBOX_CACHE_MAGIC = 0x42484248;	// "HBHB"
+const uint32_t HITBOX_CACHE_VERSION = 1;
+
+class HitBoxRegistry
+{
+protected:
+	HitBoxRegistry()
+	{}
+
+	struct Entry {
+		// Source file the box was computed from, it is valid only while both are unchanged
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		HitBox_t box;
+		bool used = false;
+	};
+
+	std::map<std::string, Entry> entries;
+	bool cacheRead = false;
+	bool changed = false;
+
+	std::string cacheFile() {
+		return MeshCache::GetInstance()->getFolder() + "/hitboxes.bin";
+	}
+
+	// Read the collision file of the previous run, a missing or invalid file only means an empty registry
+	void readCache() {
+		cacheRead = true;
+		if (!MeshCache::GetInstance()->isEnabled()) {
+			return;
+		}
+		std::ifstream in(cacheFile(), std::ios::binary);
+		uint32_t magic = 0, version = 0, count = 0;
+		in.read((char*)&magic, sizeof(magic));
+		in.read((char*)&version, sizeof(version));
+		in.read((char*)&count, sizeof(count));
+		if (!in || magic != HITBOX_CACHE_MAGIC || version != HITBOX_CACHE_VERSION) {
+			return;
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t pathLength = 0;
+			in.read((char*)&pathLength, sizeof(pathLength));
+			if (!in || pathLength > 4096) {
+				entries.clear();
+				return;
+			}
+			std::string path(pathLength, '\0');
+			Entry entry;
+			in.read(&path[0], pathLength);
+			in.read((char*)&entry.sourceSize, sizeof(entry.sourceSize));
+			in.read((char*)&entry.sourceTime, sizeof(entry.sourceTime));
+			in.read((char*)&entry.box, sizeof(entry.box));
+			if (!in) {
+				entries.clear();
+				return;
+			}
+			entries[path] = entry;
+		}
+	}
+
+	// Min and max of the "v x y z" lines, in a single pass over the file
+	static HitBox_t parseBounds(const std::string& file) {
+		std::ifstream in(file, std::ios::binary);
+		if (!in.is_open()) {
+			throw std::runtime_error("failed to open hit box " + file + "!");
+		}
+		std::stringstream buffer;
+		buffer << in.rdbuf();
+		std::string text = buffer.str();
+
+		glm::vec3 minimum(std::numeric_limits<float>::max());
+		glm::vec3 maximum(std::numeric_limits<float>::lowest());
+		bool found = false;
+		const char* c = text.c_str();
+		while (*c != '\0') {
+			if (c[0] == 'v' && (c[1] == ' ' || c[1] == '\t')) {
+				char* end;
+				glm::vec3 v;
+				v.x = strtof(c + 2, &end);
+				v.y = strtof(end, &end);
+				v.z = strtof(end, &end);
+				minimum = glm::min(minimum, v);
+				maximum = glm::max(maximum, v);
+				found = true;
+				c = end;
+			}
+			while (*c != '\0' && *c != '\n') {
+				c++;
+			}
+			if (*c == '\n') {
+				c++;
+			}
+		}
+		if (!found) {
+			throw std::runtime_error("no vertices in hit box " + file + "!");
+		}
+
+		HitBox_t box;
+		box.x = glm::vec2(minimum.x, maximum.x);
+		box.y = glm::vec2(minimum.y, maximum.y);
+		box.z = glm::vec2(minimum.z, maximum.z);
+		return box;
+	}
+
+public:
+
+	HitBoxRegistry(HitBoxRegistry& other) = delete;
+
+	void operator=(const HitBoxRegistry&) = delete;
+
+	static HitBoxRegistry* GetInstance();
+
+	// Box around all the vertices of the OBJ file, read from the file only the first time or when it changed
+	HitBox_t get(const std::string& file) {
+		if (!cacheRead) {
+			readCache();
+		}
+		uint64_t size = 0;
+		int64_t time = 0;
+		MeshCache::sourceInfo(file, size, time);
+		auto found = entries.find(file);
+		if (found != entries.end() && found->second.sourceSize == size && found->second.sourceTime == time) {
+			found->second.used = true;
+			return found->second.box;
+		}
+
+		Entry entry;
+		entry.sourceSize = size;
+		entry.sourceTime = time;
+		entry.box = parseBounds(file);
+		entry.used = true;
+		entries[file] = entry;
+		changed = true;
+		return entry.box;
+	}
+
+	// Write the boxes used in this run if some of them were read from their OBJ, a failure only means
+	// that they will be read again the next time
+	void save() {
+		bool unused = std::any_of(entries.begin(), entries.end(),
+								  [](const std::pair<const std::string, Entry>& entry) { return !entry.second.used; });
+		if (!MeshCache::GetInstance()->isEnabled() || (!changed && !unused)) {
+			return;
+		}
+		changed = false;
+
+		std::error_code error;
+		std::filesystem::create_directories(MeshCache::GetInstance()->getFolder(), error);
+		std::ofstream out(cacheFile(), std::ios::binary);
+		if (!out.is_open()) {
+			std::cout << "failed to write the hit box cache " << cacheFile() << "\n";
+			return;
+		}
+		uint32_t count = 0;
+		for (auto const& entry : entries) {
+			count += entry.second.used ? 1 : 0;
+		}
+		out.write((const char*)&HITBOX_CACHE_MAGIC, sizeof(HITBOX_CACHE_MAGIC));
+		out.write((const char*)&HITBOX_CACHE_VERSION, sizeof(HITBOX_CACHE_VERSION));
+		out.write((const char*)&count, sizeof(count));
+		for (auto const& entry : entries) {
+			if (!entry.second.used) {
+				continue;
+			}
+			uint32_t pathLength = entry.first.size();
+			out.write((const char*)&pathLength, sizeof(pathLength));
+			out.write(entry.first.data(), pathLength);
+			out.write((const char*)&entry.second.sourceSize, sizeof(entry.second.sourceSize));
+			out.write((const char*)&entry.second.sourceTime, sizeof(entry.second.sourceTime));
+			out.write((const char*)&entry.second.box, sizeof(entry.second.box));
+		}
+	}
+};
+HitBoxRegistry* HitBoxRegistry::GetInstance()
+{
+	static HitBoxRegistry* singleton_ = new HitBoxRegistry();
+	return singleton_;
+}
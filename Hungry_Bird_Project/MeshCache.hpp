@@ -0,0 +1,296 @@
+// Binary mesh cache: the vertices and indices of a parsed model are saved once and then memory mapped on
+// the next runs, so the OBJ is parsed only when it changes
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read only view of a whole file
+class MappedFile {
+	const uint8_t* bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	void operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+		close();
+	}
+
+	bool open(const std::string& path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+						   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			close();
+			return false;
+		}
+		bytes = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		length = (size_t)fileSize.QuadPart;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		void* view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (view == MAP_FAILED) {
+			return false;
+		}
+		bytes = (const uint8_t*)view;
+		length = info.st_size;
+#endif
+		if (bytes == nullptr) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+#ifdef _WIN32
+		if (bytes != nullptr) {
+			UnmapViewOfFile(bytes);
+		}
+		if (mapping != NULL) {
+			CloseHandle(mapping);
+			mapping = NULL;
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (bytes != nullptr) {
+			munmap((void*)bytes, length);
+		}
+#endif
+		bytes = nullptr;
+		length = 0;
+	}
+
+	const uint8_t* data() const {
+		return bytes;
+	}
+
+	size_t size() const {
+		return length;
+	}
+};
+
+const uint32_t MESH_CACHE_MAGIC = 0x434d4248;	// "HBMC"
+const uint32_t MESH_CACHE_VERSION = 3;
+
+// Processing baked into the cached arrays, a cache built with different flags is built again
+enum MeshCacheFlags : uint32_t {
+	MESH_CACHE_OPTIMIZED = 1	// triangles and vertices reordered by MeshOptimizer
+};
+
+// The file starts with this header, followed by the source path, the vertices and the indices
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	// Source file the cache was built from, the cache is valid only while both are unchanged
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t pathLength;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t flags;
+	// 2 or 4 bytes
+	uint32_t indexSize;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	float aabbMin[3];
+	float aabbMax[3];
+};
+
+class MeshCache
+{
+protected:
+	MeshCache()
+	{}
+
+	bool enabled = true;
+	bool optimization = true;
+	std::string folder = "MeshCache";
+
+	static uint64_t align16(uint64_t offset) {
+		return (offset + 15) & ~(uint64_t)15;
+	}
+
+public:
+
+	MeshCache(MeshCache& other) = delete;
+
+	void operator=(const MeshCache&) = delete;
+
+	static MeshCache* GetInstance();
+
+	void setEnabled(bool enable) {
+		enabled = enable;
+	}
+
+	bool isEnabled() {
+		return enabled;
+	}
+
+	// Reorder the parsed models for the vertex cache, overdraw and vertex fetch before they are cached (default true)
+	void setOptimization(bool enable) {
+		optimization = enable;
+	}
+
+	bool isOptimizing() {
+		return optimization;
+	}
+
+	uint32_t currentFlags() {
+		return optimization ? (uint32_t)MESH_CACHE_OPTIMIZED : 0u;
+	}
+
+	std::string getFolder() {
+		return folder;
+	}
+
+	// Size and modification time of a source file, used to detect that a cache is out of date
+	static bool sourceInfo(const std::string& source, uint64_t& size, int64_t& time) {
+		std::error_code error;
+		size = std::filesystem::file_size(source, error);
+		if (error) {
+			return false;
+		}
+		time = std::filesystem::last_write_time(source, error).time_since_epoch().count();
+		return !error;
+	}
+
+	// One file for each source path, named after its FNV-1a hash
+	std::string cachePath(const std::string& source) {
+		uint64_t hash = 14695981039346656037ull;
+		for (char c : source) {
+			hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+		}
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long)hash);
+		return folder + "/" + name;
+	}
+
+	// Map the cache of source, false if it is missing or out of date. On success the header
+	// and the arrays point inside file, which must stay open while they are used
+	bool load(const std::string& source, uint32_t vertexStride, MappedFile& file, const MeshCacheHeader*& header) {
+		uint64_t size;
+		int64_t time;
+		if (!enabled || !sourceInfo(source, size, time) || !file.open(cachePath(source))) {
+			return false;
+		}
+
+		if (file.size() < sizeof(MeshCacheHeader)) {
+			file.close();
+			return false;
+		}
+		header = (const MeshCacheHeader*)file.data();
+		bool valid = header->magic == MESH_CACHE_MAGIC && header->version == MESH_CACHE_VERSION &&
+					 header->sourceSize == size && header->sourceTime == time &&
+					 header->vertexStride == vertexStride && header->flags == currentFlags() &&
+					 sizeof(MeshCacheHeader) + header->pathLength <= file.size() &&
+					 std::string((const char*)file.data() + sizeof(MeshCacheHeader), header->pathLength) == source &&
+					 header->vertexOffset + (uint64_t)header->vertexCount * vertexStride <= file.size() &&
+					 (header->indexSize == sizeof(uint16_t) || header->indexSize == sizeof(uint32_t)) &&
+					 header->indexOffset + (uint64_t)header->indexCount * header->indexSize <= file.size();
+		if (!valid) {
+			file.close();
+			return false;
+		}
+		return true;
+	}
+
+	// Write the cache of source, a failure only means that it will be parsed again the next time
+	void save(const std::string& source, const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+			  const void* indices, uint32_t indexCount, uint32_t indexSize, const float aabbMin[3], const float aabbMax[3]) {
+		MeshCacheHeader header{};
+		if (!enabled || !sourceInfo(source, header.sourceSize, header.sourceTime)) {
+			return;
+		}
+		header.magic = MESH_CACHE_MAGIC;
+		header.version = MESH_CACHE_VERSION;
+		header.pathLength = source.size();
+		header.vertexStride = vertexStride;
+		header.vertexCount = vertexCount;
+		header.indexCount = indexCount;
+		header.flags = currentFlags();
+		header.indexSize = indexSize;
+		header.vertexOffset = align16(sizeof(MeshCacheHeader) + source.size());
+		header.indexOffset = align16(header.vertexOffset + (uint64_t)vertexCount * vertexStride);
+		memcpy(header.aabbMin, aabbMin, sizeof(header.aabbMin));
+		memcpy(header.aabbMax, aabbMax, sizeof(header.aabbMax));
+
+		std::error_code error;
+		std::filesystem::create_directories(folder, error);
+		std::string path = cachePath(source);
+		// Two threads may be saving the same model
+		std::string temporaryPath = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		{
+			std::ofstream out(temporaryPath, std::ios::binary);
+			if (!out.is_open()) {
+				std::cout << "failed to write the mesh cache " << path << "\n";
+				return;
+			}
+			const char padding[16] = {};
+			out.write((const char*)&header, sizeof(header));
+			out.write(source.data(), source.size());
+			out.write(padding, header.vertexOffset - sizeof(header) - source.size());
+			out.write((const char*)vertices, (size_t)vertexCount * vertexStride);
+			out.write(padding, header.indexOffset - header.vertexOffset - (uint64_t)vertexCount * vertexStride);
+			out.write((const char*)indices, (size_t)indexCount * indexSize);
+		}
+		// Replace the old file only when the new one is complete
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error) {
+			std::filesystem::remove(path, error);
+			std::filesystem::rename(temporaryPath, path, error);
+		}
+	}
+};
+MeshCache* MeshCache::GetInstance()
+{
+	// Used also by the loading threads: the local static is created only once
+	static MeshCache* singleton_ = new MeshCache();
+	return singleton_;
+}
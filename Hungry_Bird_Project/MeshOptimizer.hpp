@@ -0,0 +1,248 @@
+// Reordering of the triangles and vertices of a mesh for the GPU: post-transform vertex cache locality
+// (Tipsify), overdraw (clusters sorted from the outside in) and vertex fetch locality (first use order)
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+// Size of the post-transform cache the triangles are ordered for
+const uint32_t MESH_OPTIMIZER_CACHE_SIZE = 16;
+// A cluster may be split where its cache miss ratio is at most this much worse than the whole cluster
+const float MESH_OPTIMIZER_OVERDRAW_THRESHOLD = 1.05f;
+
+// Triangles around every vertex, in compressed rows: the triangles of v are triangles[offsets[v]..offsets[v + 1]]
+struct MeshAdjacency {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> triangles;
+
+	MeshAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount) : offsets(vertexCount + 1, 0) {
+		for (uint32_t index : indices) {
+			offsets[index + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++) {
+			offsets[v + 1] += offsets[v];
+		}
+		triangles.resize(indices.size());
+		std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) {
+			triangles[filled[indices[i]]++] = (uint32_t)(i / 3);
+		}
+	}
+};
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"):
+// fan around a vertex still in the cache, and jump elsewhere only at a dead end. Every jump starts a new cluster,
+// whose first triangle is added to clusters
+inline std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+												 std::vector<uint32_t>& clusters) {
+	const uint32_t cacheSize = MESH_OPTIMIZER_CACHE_SIZE;
+	size_t triangleCount = indices.size() / 3;
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	clusters.clear();
+	if (triangleCount == 0) {
+		return result;
+	}
+
+	MeshAdjacency adjacency(indices, vertexCount);
+	std::vector<uint32_t> liveTriangles(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+	}
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<uint32_t> deadEnds;
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> candidates;
+	uint32_t time = cacheSize + 1;
+	size_t cursor = 0;
+
+	// The vertices of the input in order, used when the dead end stack is empty
+	auto skipDeadEnd = [&]() -> int64_t {
+		while (!deadEnds.empty()) {
+			uint32_t v = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[v] > 0) {
+				return v;
+			}
+		}
+		while (cursor < indices.size()) {
+			uint32_t v = indices[cursor++];
+			if (liveTriangles[v] > 0) {
+				return v;
+			}
+		}
+		return -1;
+	};
+
+	int64_t fanning = indices[0];
+	clusters.push_back(0);
+	while (fanning >= 0) {
+		candidates.clear();
+		for (uint32_t k = adjacency.offsets[fanning]; k < adjacency.offsets[fanning + 1]; k++) {
+			uint32_t t = adjacency.triangles[k];
+			if (emitted[t]) {
+				continue;
+			}
+			emitted[t] = true;
+			for (int c = 0; c < 3; c++) {
+				uint32_t v = indices[3 * t + c];
+				result.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize) {
+					cacheTime[v] = time++;
+				}
+			}
+		}
+
+		// The candidate that stays in the cache the longest while its remaining triangles are emitted
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t v : candidates) {
+			if (liveTriangles[v] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+				priority = time - cacheTime[v];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = v;
+			}
+		}
+		if (next < 0) {
+			next = skipDeadEnd();
+			if (next >= 0 && result.size() < indices.size()) {
+				clusters.push_back((uint32_t)(result.size() / 3));
+			}
+		}
+		fanning = next;
+	}
+	return result;
+}
+
+// Cache misses of the triangles first..last of indices with a FIFO cache, emptied when time is advanced past it
+inline uint32_t simulateVertexCache(const std::vector<uint32_t>& indices, size_t first, size_t last,
+									std::vector<uint32_t>& cacheTime, uint32_t& time) {
+	uint32_t misses = 0;
+	for (size_t i = 3 * first; i < 3 * last; i++) {
+		uint32_t v = indices[i];
+		if (time - cacheTime[v] > MESH_OPTIMIZER_CACHE_SIZE) {
+			cacheTime[v] = time++;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+// Sort the clusters of optimizeVertexCache so that the triangles facing away from the center of the mesh,
+// which are likely to hide the others, are drawn first. The clusters are first split where the cache
+// locality allows it, so that the order can be finer than the dead ends of Tipsify
+inline void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters,
+							 const float* positions, size_t positionStride, size_t vertexCount) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || clusters.empty()) {
+		return;
+	}
+
+	std::vector<uint32_t> boundaries;
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t time = MESH_OPTIMIZER_CACHE_SIZE + 1;
+	for (size_t c = 0; c < clusters.size(); c++) {
+		size_t begin = clusters[c];
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		time += MESH_OPTIMIZER_CACHE_SIZE + 1;
+		float clusterRatio = (float)simulateVertexCache(indices, begin, end, cacheTime, time) / (end - begin);
+
+		// A new cluster can start with an empty cache wherever the misses so far are close to the cluster average
+		time += MESH_OPTIMIZER_CACHE_SIZE + 1;
+		boundaries.push_back((uint32_t)begin);
+		size_t start = begin;
+		uint32_t misses = 0;
+		for (size_t t = begin; t < end; t++) {
+			misses += simulateVertexCache(indices, t, t + 1, cacheTime, time);
+			if (t + 1 < end && (float)misses / (t + 1 - start) <= clusterRatio * MESH_OPTIMIZER_OVERDRAW_THRESHOLD) {
+				boundaries.push_back((uint32_t)(t + 1));
+				start = t + 1;
+				misses = 0;
+				time += MESH_OPTIMIZER_CACHE_SIZE + 1;
+			}
+		}
+	}
+	boundaries.push_back((uint32_t)triangleCount);
+
+	auto position = [&](uint32_t v) {
+		glm::vec3 p;
+		memcpy(&p, (const char*)positions + v * positionStride, sizeof(p));
+		return p;
+	};
+
+	// Area weighted centroid of the mesh and of every cluster, and the average normal of every cluster
+	size_t clusterCount = boundaries.size() - 1;
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> areas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; c++) {
+		for (uint32_t t = boundaries[c]; t < boundaries[c + 1]; t++) {
+			glm::vec3 a = position(indices[3 * t]);
+			glm::vec3 b = position(indices[3 * t + 1]);
+			glm::vec3 d = position(indices[3 * t + 2]);
+			glm::vec3 normal = glm::cross(b - a, d - a);
+			float area = glm::length(normal);
+			centroids[c] += (a + b + d) * (area / 3.0f);
+			normals[c] += normal;
+			areas[c] += area;
+		}
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	std::vector<float> keys(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; c++) {
+		float normalLength = glm::length(normals[c]);
+		if (areas[c] > 0.0f && normalLength > 0.0f) {
+			keys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / normalLength);
+		}
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		order[c] = (uint32_t)c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (uint32_t c : order) {
+		result.insert(result.end(), indices.begin() + 3 * boundaries[c], indices.begin() + 3 * boundaries[c + 1]);
+	}
+	indices.swap(result);
+}
+
+// Renumber the vertices in the order they are first used by the triangles, dropping the unused ones
+template <typename V>
+void optimizeVertexFetch(std::vector<V>& vertices, std::vector<uint32_t>& indices) {
+	const uint32_t unused = UINT32_MAX;
+	std::vector<uint32_t> remap(vertices.size(), unused);
+	std::vector<V> result;
+	result.reserve(vertices.size());
+	for (uint32_t& index : indices) {
+		if (remap[index] == unused) {
+			remap[index] = (uint32_t)result.size();
+			result.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(result);
+}
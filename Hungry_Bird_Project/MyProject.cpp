@@ -1,11 +1,18 @@
 // This has been adapted from the Vulkan tutorial
 
 #include "MyProject.hpp"
+#include "HitBox.hpp"
+#include "HitBoxRegistry.hpp"
+#include "Scene.hpp"
 #include <list>
+#include <iomanip>
+#include <random>
+#include <memory>
 
 const std::string MODEL_PATH = "Assets/models";
 const std::string TEXTURE_PATH = "Assets/textures";
-const std::string HITBOXDEC_PATH = "Assets/models/HitBoxDecorations";
+const std::string SCENE_PATH = "Assets/scenes/level.json";
+const std::string COMPACT_MATERIAL_SHADER = "shaders/materialCompactVert.spv";
 
 bool cameraON = true;
 
@@ -13,11 +20,7 @@ const glm::vec3 CANNON_BOT_POS = glm::vec3(-0.45377f, 8.78275f, -3.0006f);
 const glm::vec3 CANNON_TOP_POS = glm::vec3(-0.45377f, 9.50215f, -3.0006f);
 
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
-
-// The hitboxes are boxes placed with edges parallel to xyz axis -> we need only 6 values to save them
-typedef struct HitBox_s {
-	glm::vec2 x, y, z;
-}HitBox_t;
+void handleKey(int key, int action);
 
 // Switch between the two controller modes to choose what to move using wasd keys
 enum GameController {
@@ -53,6 +56,7 @@ protected:
 	static GameTime* singleton_;
 	float deltaT = 0;
 	float time = 0;
+	float fixedStep = 0;
 
 public:
 
@@ -62,7 +66,16 @@ public:
 
 	static GameTime* GetInstance();
 
+	// Advance the time of exactly step seconds every frame instead of following the clock (0 = use the clock)
+	void setFixedStep(float step) {
+		fixedStep = step;
+	}
+
 	void setTime() {
+		if (fixedStep > 0) {
+			setTime(time + fixedStep, fixedStep);
+			return;
+		}
 		static auto startTime = std::chrono::high_resolution_clock::now();
 		static float lastTime = 0.0f;
 		auto currentTime = std::chrono::high_resolution_clock::now();
@@ -72,6 +85,12 @@ public:
 		lastTime = time;
 	}
 
+	// Set the time from outside, used to replay a recorded session
+	void setTime(float newTime, float newDeltaT) {
+		time = newTime;
+		deltaT = newDeltaT;
+	}
+
 	float getDelta() {
 		return deltaT;
 	}
@@ -90,6 +109,295 @@ GameTime* GameTime::GetInstance()
 	return singleton_;
 }
 
+//Singleton class that collects the real duration of every frame in histograms of 0.1 ms buckets:
+//one for the current log interval and one for the whole session.
+//It logs p50/p95/p99/max and the hitches (frames longer than twice the median) every interval and at exit.
+class FrameStats
+{
+protected:
+	FrameStats()
+	{}
+
+	static constexpr int BUCKETS = 2000;
+	static constexpr float BUCKET_MS = 0.1f;
+
+	struct Histogram {
+		std::vector<uint32_t> buckets = std::vector<uint32_t>(BUCKETS + 1, 0);
+		uint64_t frames = 0;
+		uint64_t hitches = 0;
+		float maxMs = 0;
+		double totalMs = 0;
+
+		void add(float ms) {
+			int bucket = std::min((int)(ms / BUCKET_MS), BUCKETS);
+			buckets[bucket]++;
+			frames++;
+			totalMs += ms;
+			maxMs = std::max(maxMs, ms);
+		}
+
+		// Upper bound of the bucket that contains the percentile, the last bucket holds every slower frame
+		float percentile(float p) {
+			uint64_t target = (uint64_t)std::ceil(p * frames);
+			uint64_t count = 0;
+			for (int i = 0; i <= BUCKETS; i++) {
+				count += buckets[i];
+				if (count >= target && count > 0) {
+					return i == BUCKETS ? maxMs : std::min((i + 1) * BUCKET_MS, maxMs);
+				}
+			}
+			return maxMs;
+		}
+	};
+
+	static FrameStats* singleton_;
+	bool enabled = false;
+	bool started = false;
+	float interval = 0;
+	Histogram session;
+	Histogram current;
+	float medianMs = 0;
+	std::chrono::high_resolution_clock::time_point lastFrame;
+	std::chrono::high_resolution_clock::time_point lastLog;
+
+	void log(const char* title, Histogram& histogram) {
+		if (histogram.frames == 0) {
+			return;
+		}
+		std::cout << std::fixed << std::setprecision(2) << title << ": " << histogram.frames << " frames, avg "
+				  << histogram.totalMs / histogram.frames << " ms, p50 " << histogram.percentile(0.50f)
+				  << " ms, p95 " << histogram.percentile(0.95f) << " ms, p99 " << histogram.percentile(0.99f)
+				  << " ms, max " << histogram.maxMs << " ms, " << histogram.hitches << " hitches\n"
+				  << std::defaultfloat;
+	}
+
+public:
+
+	FrameStats(FrameStats& other) = delete;
+
+	void operator=(const FrameStats&) = delete;
+
+	static FrameStats* GetInstance();
+
+	// Log the statistics every logInterval seconds (0 = only at exit)
+	void start(float logInterval) {
+		enabled = true;
+		interval = logInterval;
+	}
+
+	// Called once per frame, it uses the real clock even when GameTime runs with a fixed step or a replay
+	void frame() {
+		if (!enabled) {
+			return;
+		}
+		auto now = std::chrono::high_resolution_clock::now();
+		if (!started) {
+			started = true;
+			lastFrame = now;
+			lastLog = now;
+			return;
+		}
+		float ms = std::chrono::duration<float, std::milli>(now - lastFrame).count();
+		lastFrame = now;
+
+		session.add(ms);
+		current.add(ms);
+		// The median moves slowly, update it only every 64 frames
+		if (session.frames % 64 == 1) {
+			medianMs = session.percentile(0.5f);
+		}
+		if (session.frames > 64 && ms > 2 * medianMs) {
+			session.hitches++;
+			current.hitches++;
+		}
+
+		if (interval > 0 && std::chrono::duration<float>(now - lastLog).count() >= interval) {
+			log("Frame times", current);
+			current = Histogram();
+			lastLog = now;
+		}
+	}
+
+	void stop() {
+		if (enabled) {
+			log("Frame times of the session", session);
+			enabled = false;
+		}
+	}
+};
+FrameStats* FrameStats::singleton_ = nullptr;
+FrameStats* FrameStats::GetInstance()
+{
+	if (singleton_ == nullptr) {
+		singleton_ = new FrameStats();
+	}
+	return singleton_;
+}
+
+//Singleton class that records the input of a session to a file and plays it back,
+//so the same game can be rerun as a benchmark doing identical work every run.
+//Every frame it stores the GameTime values, the polled keys held down and the key events of the callback:
+//	K <frame> <key> <action>
+//	F <frame> <time> <deltaT> <number of held keys> <held keys...>
+class InputReplay
+{
+protected:
+	InputReplay()
+	{}
+
+	enum Mode {
+		Live,
+		Record,
+		Replay
+	};
+
+	static InputReplay* singleton_;
+	Mode mode = Live;
+	std::ofstream recordFile;
+	std::ifstream replayFile;
+	int frame = 0;
+	bool finished = false;
+
+	// Keys polled every frame by the game objects
+	const std::vector<int> POLLED_KEYS = {
+		GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_UP, GLFW_KEY_DOWN,
+		GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_S, GLFW_KEY_W,
+		GLFW_KEY_F, GLFW_KEY_R, GLFW_KEY_Q, GLFW_KEY_E
+	};
+	std::set<int> heldKeys;
+
+public:
+	//Remove public methods for construction and modify of singleton
+	InputReplay(InputReplay& other) = delete;
+	void operator=(const InputReplay&) = delete;
+
+	static InputReplay* GetInstance();
+
+	void startRecording(std::string path) {
+		recordFile.open(path);
+		if (!recordFile.is_open()) {
+			throw std::runtime_error("failed to open input recording " + path);
+		}
+		recordFile << std::setprecision(9);
+		mode = Record;
+	}
+
+	void startReplay(std::string path) {
+		replayFile.open(path);
+		if (!replayFile.is_open()) {
+			throw std::runtime_error("failed to open input recording " + path);
+		}
+		mode = Replay;
+	}
+
+	bool isReplaying() {
+		return mode == Replay;
+	}
+
+	// True once every recorded frame has been played back
+	bool isFinished() {
+		return finished;
+	}
+
+	// Called by the key callback, the event is applied to the frame that is about to start
+	void recordKey(int key, int action) {
+		if (mode == Record) {
+			recordFile << "K " << frame << " " << key << " " << action << "\n";
+		}
+	}
+
+	// Called once at the start of every frame: updates GameTime and the state of the polled keys
+	void beginFrame(GLFWwindow* window) {
+		if (mode == Replay) {
+			replayFrame();
+			return;
+		}
+
+		GameTime* gameTime = GameTime::GetInstance();
+		gameTime->setTime();
+		if (mode == Record) {
+			heldKeys.clear();
+			for (int key : POLLED_KEYS) {
+				if (window != nullptr && glfwGetKey(window, key) == GLFW_PRESS) {
+					heldKeys.insert(key);
+				}
+			}
+			recordFile << "F " << frame << " " << gameTime->getTime() << " " << gameTime->getDelta() << " " << heldKeys.size();
+			for (int key : heldKeys) {
+				recordFile << " " << key;
+			}
+			recordFile << "\n";
+		}
+		frame++;
+	}
+
+	bool isPressed(GLFWwindow* window, int key) {
+		if (mode == Live) {
+			return window != nullptr && glfwGetKey(window, key) == GLFW_PRESS;
+		}
+		return heldKeys.count(key) > 0;
+	}
+
+	void stop() {
+		if (recordFile.is_open()) {
+			recordFile.close();
+		}
+		if (replayFile.is_open()) {
+			replayFile.close();
+		}
+	}
+
+private:
+	// Apply the key events of the next recorded frame, then its time and held keys
+	void replayFrame() {
+		std::string type;
+		int recordedFrame;
+		while (replayFile >> type >> recordedFrame) {
+			if (type == "K") {
+				int key, action;
+				replayFile >> key >> action;
+				handleKey(key, action);
+			}
+			else if (type == "F") {
+				float time, deltaT;
+				size_t count;
+				replayFile >> time >> deltaT >> count;
+				heldKeys.clear();
+				for (size_t i = 0; i < count; i++) {
+					int key;
+					replayFile >> key;
+					heldKeys.insert(key);
+				}
+				GameTime::GetInstance()->setTime(time, deltaT);
+				frame++;
+				return;
+			}
+			else {
+				throw std::runtime_error("corrupted input recording at frame " + std::to_string(recordedFrame));
+			}
+		}
+
+		// End of the recording: keep the game still until the application stops
+		finished = true;
+		heldKeys.clear();
+		GameTime* gameTime = GameTime::GetInstance();
+		gameTime->setTime(gameTime->getTime(), 0.0f);
+	}
+};
+InputReplay* InputReplay::singleton_ = nullptr;
+InputReplay* InputReplay::GetInstance()
+{
+	if (singleton_ == nullptr) {
+		singleton_ = new InputReplay();
+	}
+	return singleton_;
+}
+
+// Polled key state, coming from the recording during a replay (no window to poll in headless mode)
+bool isKeyPressed(GLFWwindow* window, int key) {
+	return InputReplay::GetInstance()->isPressed(window, key);
+}
+
 class Camera {
 protected:
 	Camera()
@@ -122,16 +430,16 @@ public:
 	glm::mat4 update(GLFWwindow* window) {
 		float deltaT = GameTime::GetInstance()->getDelta();
 		// Camera direction
-		if (glfwGetKey(window, GLFW_KEY_LEFT)) {
+		if (isKeyPressed(window, GLFW_KEY_LEFT)) {
 			CamAng.y += deltaT * ROT_SPEED;
 		}
-		if (glfwGetKey(window, GLFW_KEY_RIGHT)) {
+		if (isKeyPressed(window, GLFW_KEY_RIGHT)) {
 			CamAng.y -= deltaT * ROT_SPEED;
 		}
-		if (glfwGetKey(window, GLFW_KEY_UP)) {
+		if (isKeyPressed(window, GLFW_KEY_UP)) {
 			CamAng.x += deltaT * ROT_SPEED;
 		}
-		if (glfwGetKey(window, GLFW_KEY_DOWN)) {
+		if (isKeyPressed(window, GLFW_KEY_DOWN)) {
 			CamAng.x -= deltaT * ROT_SPEED;
 		}
 
@@ -141,26 +449,26 @@ public:
 
 		// Camera position
 		if (controller == CameraMovement) {
-			if (glfwGetKey(window, GLFW_KEY_A)) {
+			if (isKeyPressed(window, GLFW_KEY_A)) {
 				CamPos -= MOVE_SPEED * glm::vec3(glm::rotate(glm::mat4(1.0f), CamAng.y,
 					glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(1, 0, 0, 1)) * deltaT;
 			}
-			if (glfwGetKey(window, GLFW_KEY_D)) {
+			if (isKeyPressed(window, GLFW_KEY_D)) {
 				CamPos += MOVE_SPEED * glm::vec3(glm::rotate(glm::mat4(1.0f), CamAng.y,
 					glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(1, 0, 0, 1)) * deltaT;
 			}
-			if (glfwGetKey(window, GLFW_KEY_S)) {
+			if (isKeyPressed(window, GLFW_KEY_S)) {
 				CamPos += MOVE_SPEED * glm::vec3(glm::rotate(glm::mat4(1.0f), CamAng.y,
 					glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(0, 0, 1, 1)) * deltaT;
 			}
-			if (glfwGetKey(window, GLFW_KEY_W)) {
+			if (isKeyPressed(window, GLFW_KEY_W)) {
 				CamPos -= MOVE_SPEED * glm::vec3(glm::rotate(glm::mat4(1.0f), CamAng.y,
 					glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(0, 0, 1, 1)) * deltaT;
 			}
-			if (glfwGetKey(window, GLFW_KEY_F)) {
+			if (isKeyPressed(window, GLFW_KEY_F)) {
 				CamPos -= MOVE_SPEED * glm::vec3(0, 1, 0) * deltaT;
 			}
-			if (glfwGetKey(window, GLFW_KEY_R)) {
+			if (isKeyPressed(window, GLFW_KEY_R)) {
 				CamPos += MOVE_SPEED * glm::vec3(0, 1, 0) * deltaT;
 			}
 		}
@@ -226,32 +534,135 @@ Camera* Camera::GetInstance()
 class Asset {
 protected:
 	Model _model;
-	Texture _texture;
+	// Shared with the other assets using the same file, owned by the texture registry
+	Texture* _texture = nullptr;
+	std::string _textureFile;
+	// Used instead when the texture is embedded in a glTF model
+	Texture _embeddedTexture;
+	bool _hasEmbeddedTexture = false;
 	std::vector<DescriptorSet*> _dSetVector;
+	BaseProject* _bp = nullptr;
+	// Model parsing running on the loading threads
+	std::future<void> _modelLoading;
+	// Kept to load the model again when its file changes
+	std::string _modelFile;
+	bool _compact = false;
 
 public:
-	// initialize model and texture
+	// initialize model and texture: the files are read by the loading threads, the GPU upload is done by finishLoading.
+	// With an empty texturePath the texture embedded in the model (.glb) is used
 	void init(BaseProject* bp, std::string modelPath, std::string texturePath, DescriptorSetLayout* DSLobj) {
-			_model.init(bp, MODEL_PATH + modelPath);
-			_texture.init(bp, TEXTURE_PATH + texturePath);
+			_bp = bp;
+			std::string modelFile = MODEL_PATH + modelPath;
+			_hasEmbeddedTexture = texturePath.empty();
+			bool compact = bp->usesCompactVertices();
+			_modelFile = modelFile;
+			_compact = compact;
+			bp->watchFile(modelFile);
+			_modelLoading = bp->getLoadingPool()->submit([this, modelFile, compact]() {
+				_model.load(modelFile);
+				if (compact) {
+					_model.quantize();
+				}
+				if (_hasEmbeddedTexture) {
+					if (_model.embeddedTexture.empty()) {
+						throw std::runtime_error("no embedded texture in " + modelFile + "!");
+					}
+					_embeddedTexture.loadFromMemory(modelFile + " (texture)", _model.embeddedTexture);
+					_model.embeddedTexture.clear();
+				}
+			});
+			if (!_hasEmbeddedTexture) {
+				_textureFile = TEXTURE_PATH + texturePath;
+				bp->getTextureRegistry()->acquire(_textureFile);
+			}
+	}
+
+	// Wait for the loading threads and upload model and texture, errors of the loading are rethrown
+	void finishLoading() {
+		if (_modelLoading.valid()) {
+			_modelLoading.get();
+			_model.upload(_bp);
+			if (_hasEmbeddedTexture) {
+				_embeddedTexture.upload(_bp);
+				_texture = &_embeddedTexture;
+			}
+		}
+		if (_texture == nullptr && !_textureFile.empty()) {
+			_texture = _bp->getTextureRegistry()->finish(_textureFile);
+		}
 	}
 
 	// Add a descriptorSet which means a new gameObject of the asset to render
 	void addDSet(BaseProject* bp, DescriptorSetLayout* DSLobj, DescriptorSet* dSet) {
+		finishLoading();
 		_dSetVector.push_back(dSet);
 		(*dSet).init(bp, DSLobj, {
 		{0, UNIFORM, sizeof(UniformBufferObject), nullptr},
-		{1, TEXTURE, 0, &_texture}
+		{1, TEXTURE, 0, _texture}
 			});
 	}
 
+	// Hot reload: parse and upload the changed model again, the swap replaces the old buffers when the GPU no
+	// longer draws them. For a texture the registry is replacing, only the descriptors are written again
+	bool prepareReload(const std::string& file, std::vector<std::function<void()>>& swaps) {
+		if (!_textureFile.empty() && (file == _textureFile || file == _textureFile + TEXTURE_CONTAINER_EXTENSION)) {
+			// Runs after the swap of the registry, which keeps the texture at the same address
+			swaps.push_back([this]() {
+				for (DescriptorSet* dSet : _dSetVector) {
+					dSet->updateTexture(1, _texture);
+				}
+			});
+			return true;
+		}
+		if (file != _modelFile) {
+			return false;
+		}
+
+		std::shared_ptr<Model> model = std::make_shared<Model>();
+		model->load(file);
+		if (_compact) {
+			model->quantize();
+		}
+		std::shared_ptr<Texture> texture;
+		if (_hasEmbeddedTexture) {
+			if (model->embeddedTexture.empty()) {
+				throw std::runtime_error("no embedded texture in " + file + "!");
+			}
+			texture = std::make_shared<Texture>();
+			texture->loadFromMemory(file + " (texture)", model->embeddedTexture);
+			model->embeddedTexture.clear();
+			texture->upload(_bp);
+		}
+		model->upload(_bp);
+		swaps.push_back([this, model, texture]() {
+			_model.cleanup();
+			_model = *model;
+			if (texture) {
+				_embeddedTexture.cleanup();
+				_embeddedTexture = *texture;
+				for (DescriptorSet* dSet : _dSetVector) {
+					dSet->updateTexture(1, &_embeddedTexture);
+				}
+			}
+		});
+		return true;
+	}
+
 	// cleanup all the attributes
 	void cleanup() {
+		finishLoading();
 		for (DescriptorSet* dSet : _dSetVector)
 		{
 			(*dSet).cleanup();
 		}
-		_texture.cleanup();
+		if (_hasEmbeddedTexture) {
+			_embeddedTexture.cleanup();
+		} else {
+			_bp->getTextureRegistry()->release(_textureFile);
+		}
+		_texture = nullptr;
+		_textureFile.clear();
 		_model.cleanup();
 	}
 
@@ -261,7 +672,12 @@ public:
 		VkDeviceSize offsets[] = { 0 };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 		vkCmdBindIndexBuffer(commandBuffer, _model.indexBuffer, 0,
-			VK_INDEX_TYPE_UINT32);
+			_model.indexType);
+		if (P1->vertexFormat == VERTEX_COMPACT) {
+			MeshQuantization quantization = _model.getQuantization();
+			vkCmdPushConstants(commandBuffer, P1->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+				sizeof(MeshQuantization), &quantization);
+		}
 		for (DescriptorSet* dSet : _dSetVector)
 		{
 			vkCmdBindDescriptorSets(commandBuffer,
@@ -269,7 +685,7 @@ public:
 				(*P1).pipelineLayout, 1, 1, &(*dSet).descriptorSets[currentImage],
 				0, nullptr);
 			vkCmdDrawIndexed(commandBuffer,
-				static_cast<uint32_t>(_model.indices.size()), 1, 0, 0, 0);
+				static_cast<uint32_t>(_model.indexCount), 1, 0, 0, 0);
 		}
 	}
 };
@@ -337,7 +753,7 @@ protected:
 
 	//Compute the new position and direction of the bird during the flight, angY and angX are in degrees and points out the starting angle of the shot
 	void jump(float v0, float angY, float angX) {
-		deltaT = glfwGetTime() - startJumpTime;
+		deltaT = GameTime::GetInstance()->getTime() - startJumpTime;
 
 		birdPos.x = startPos.x + (v0 * cos(glm::radians(angY))) * deltaT * sin(glm::radians(angX));
 		birdPos.z = startPos.z + (v0 * cos(glm::radians(angY))) * deltaT * cos(glm::radians(angX));
@@ -373,7 +789,7 @@ public:
 		this->shootAng = angY;
 		this->isJumping = true;
 		this->isReady = false;
-		this->startJumpTime = glfwGetTime();
+		this->startJumpTime = GameTime::GetInstance()->getTime();
 	}
 
 	void showStat(int i) {
@@ -403,30 +819,7 @@ public:
 	}
 
 	void loadHitBox() {
-		tinyobj::attrib_t attrib;
-		std::vector<tinyobj::shape_t> shapes;
-		std::vector<tinyobj::material_t> materials;
-		std::string warn, err;
-
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-			HitBoxObj.c_str())) {
-			throw std::runtime_error(warn + err);
-		}
-
-		//Save the vertices values in a set in order to eliminate duplicates
-		std::set<float> x, y, z;
-
-		for (int i = 0; i < attrib.vertices.size(); i = i + 3)
-		{
-			x.insert(attrib.vertices[i + 0]);
-			y.insert(attrib.vertices[i + 1]);
-			z.insert(attrib.vertices[i + 2]);
-		}
-
-		//Save only first and last element of the sets 
-		_hitBox.x = glm::vec2(*x.begin(), *--x.end());
-		_hitBox.y = glm::vec2(*y.begin(), *--y.end());
-		_hitBox.z = glm::vec2(*z.begin(), *--z.end());
+		_hitBox = HitBoxRegistry::GetInstance()->get(HitBoxObj);
 
 		std::cout << "bird hit box loaded";
 	}
@@ -447,14 +840,6 @@ public:
 	}
 };
 
-class BirdBlue : public Bird {};
-
-class BirdRed : public Bird {};
-
-class BirdYellow : public Bird {};
-
-class BirdPink : public Bird {};
-
 class Effect : public GameObject {
 protected:
 	glm::vec3 _position = glm::vec3(0.0f);
@@ -513,7 +898,7 @@ class GameMaster
 protected:
 	GameMaster()
 	{}
-	int numberOfPigAlive = 6;
+	int numberOfPigAlive = 0;
 	static GameMaster* singleton_;
 	std::list<GameObject*> onScene;
 	Effect* boomEffect;
@@ -530,6 +915,11 @@ public:
 
 	static GameMaster* GetInstance();
 
+	// Pigs added to the level, the game ends when all of them have been hit
+	void addPigs(int count) {
+		numberOfPigAlive += count;
+	}
+
 	void PigHit() {
 		numberOfPigAlive--;
 		if (numberOfPigAlive == 0) {
@@ -582,6 +972,7 @@ public:
 	void handleCollision(Bird* movingObject);
 
 	void Notify(GLFWwindow* window, VkDevice device, int currentImage, void* data, UniformBufferObject ubo) {
+		TRACE_ZONE("GameMaster::Notify");
 		for (auto const& obj : onScene) {
 			obj->updateUniformBuffer(window, device, currentImage, data, ubo);
 		}
@@ -621,11 +1012,11 @@ protected:
 
 public:
 	// initialize all attributes
-	void init(BaseProject* bp, DescriptorSetLayout DSLobj, DescriptorSetLayout DSLglobal) {
-		P_Text.init(bp, "shaders/TextVert.spv", "shaders/TextFrag.spv", { &DSLglobal, &DSLobj });
+	void init(BaseProject* bp, DescriptorSetLayout* DSLobj, DescriptorSetLayout* DSLglobal) {
+		P_Text.init(bp, "shaders/TextVert.spv", "shaders/TextFrag.spv", { DSLglobal, DSLobj });
 		M_Text.initText(bp, SceneText);
 		T_Text.init(bp, TEXTURE_PATH + "/Text/Roman.png");
-		DS_Text.init(bp, &DSLobj, {
+		DS_Text.init(bp, DSLobj, {
 		{0, UNIFORM, sizeof(UniformBufferObject), nullptr},
 		{1, TEXTURE, 0, &T_Text}
 			});
@@ -657,13 +1048,13 @@ public:
 		VkDeviceSize offsets_skyBox[] = { 0 };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers_skyBox, offsets_skyBox);
 		vkCmdBindIndexBuffer(commandBuffer, M_Text.indexBuffer, 0,
-			VK_INDEX_TYPE_UINT32);
+			M_Text.indexType);
 		vkCmdBindDescriptorSets(commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			P_Text.pipelineLayout, 1, 1, &DS_Text.descriptorSets[currentImage],
 			0, nullptr);
 		vkCmdDrawIndexed(commandBuffer,
-			static_cast<uint32_t>(M_Text.indices.size()), 1, 0, 0, 0);
+			static_cast<uint32_t>(M_Text.indexCount), 1, 0, 0, 0);
 	}
 
 	// update before rendering
@@ -704,11 +1095,11 @@ protected:
 
 public:
 	// initialize all attributes
-	void init(BaseProject* bp, DescriptorSetLayout DSLobj, DescriptorSetLayout DSLglobal) {
-		P_SkyBox.init(bp, "shaders/skyBoxVert.spv", "shaders/skyBoxFrag.spv", { &DSLglobal, &DSLobj });
+	void init(BaseProject* bp, DescriptorSetLayout* DSLobj, DescriptorSetLayout* DSLglobal) {
+		P_SkyBox.init(bp, "shaders/skyBoxVert.spv", "shaders/skyBoxFrag.spv", { DSLglobal, DSLobj });
 		M_skyBox.init(bp, MODEL_PATH + "/SkyBox/SkyBox.obj");
 		T_skyBox.init(bp, TEXTURE_PATH + "/SkyBox/SkyBox.png");
-		DS_skyBox.init(bp, &DSLobj, {
+		DS_skyBox.init(bp, DSLobj, {
 		{0, UNIFORM, sizeof(UniformBufferObject), nullptr},
 		{1, TEXTURE, 0, &T_skyBox}
 			});
@@ -737,13 +1128,13 @@ public:
 		VkDeviceSize offsets_skyBox[] = { 0 };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers_skyBox, offsets_skyBox);
 		vkCmdBindIndexBuffer(commandBuffer, M_skyBox.indexBuffer, 0,
-			VK_INDEX_TYPE_UINT32);
+			M_skyBox.indexType);
 		vkCmdBindDescriptorSets(commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			P_SkyBox.pipelineLayout, 1, 1, &DS_skyBox.descriptorSets[currentImage],
 			0, nullptr);
 		vkCmdDrawIndexed(commandBuffer,
-			static_cast<uint32_t>(M_skyBox.indices.size()), 1, 0, 0, 0);
+			static_cast<uint32_t>(M_skyBox.indexCount), 1, 0, 0, 0);
 	}
 
 	// update before rendering
@@ -767,6 +1158,7 @@ class Decoration: public GameObject {
 protected:
 	std::vector<std::string> HitBoxObjs;
 	std::vector <HitBox_t> _hitBoxes;
+	glm::vec3 _offset = glm::vec3(0.0f);
 
 public:
 	// Link a list of hitboxes to this object, the hixBoxes object must be cubes with edges parallel to xyz axis
@@ -780,35 +1172,9 @@ public:
 
 	// Take the vertices of the hitboxes and save them in a struct (HitBoxes edges are parallel to xyz axis)
 	void loadHitBoxes() {
-		tinyobj::attrib_t attrib;
-		std::vector<tinyobj::shape_t> shapes;
-		std::vector<tinyobj::material_t> materials;
-		std::string warn, err;
-
 		for (std::string HitBox : HitBoxObjs)
 		{
-			if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-				HitBox.c_str())) {
-				throw std::runtime_error(warn + err);
-			}
-
-			std::set<float> x, y, z;
-
-			for (int i = 0; i < attrib.vertices.size(); i = i + 3)
-			{
-				x.insert(attrib.vertices[i + 0]);
-				y.insert(attrib.vertices[i + 1]);
-				z.insert(attrib.vertices[i + 2]);
-			}
-
-			HitBox_t hitBox;
-
-			//Save only first and last element of the sets 
-			hitBox.x = glm::vec2(*x.begin(), *--x.end());
-			hitBox.y = glm::vec2(*y.begin(), *--y.end());
-			hitBox.z = glm::vec2(*z.begin(), *--z.end());
-
-			_hitBoxes.push_back(hitBox);
+			_hitBoxes.push_back(HitBoxRegistry::GetInstance()->get(HitBox));
 
 			std::cout << "loaded hitBoxes terrain\n";
 		}
@@ -818,27 +1184,25 @@ public:
 		return _hitBoxes;
 	}
 
-	bool hasCollided(HitBox_t otherObject) override {
-		if (!_onScreen) {
-			return false;
+	// Move the model and its hitboxes by offset
+	void moveBy(glm::vec3 offset) {
+		_offset += offset;
+		for (HitBox_t& hitBox : _hitBoxes) {
+			hitBox = moveHitBox(hitBox, offset);
 		}
-		bool x, y, z;
-			
-		for (HitBox_t _hitBox : _hitBoxes) {
-			x = false; y = false; z = false;
-
-			if ((otherObject.x[0] > _hitBox.x[0] && otherObject.x[0] < _hitBox.x[1]) || (otherObject.x[1] > _hitBox.x[0] && otherObject.x[1] < _hitBox.x[1]))
-				x = true;
-			if ((otherObject.y[0] > _hitBox.y[0] && otherObject.y[0] < _hitBox.y[1]) || (otherObject.y[1] > _hitBox.y[0] && otherObject.y[1] < _hitBox.y[1]))
-				y = true;
-			if ((otherObject.z[0] > _hitBox.z[0] && otherObject.z[0] < _hitBox.z[1]) || (otherObject.z[1] > _hitBox.z[0] && otherObject.z[1] < _hitBox.z[1]))
-				z = true;
+	}
 
-			if (x && y && z)
-				return true;
+	// Become a copy of another decoration moved by offset, without loading its hitboxes again
+	void placeCopyOf(Decoration& other, glm::vec3 offset) {
+		_offset = other._offset + offset;
+		_hitBoxes.clear();
+		for (HitBox_t hitBox : other._hitBoxes) {
+			_hitBoxes.push_back(moveHitBox(hitBox, offset));
 		}
+	}
 
-		return false;
+	bool hasCollided(HitBox_t otherObject) override {
+		return decorationCollided(_onScreen, _hitBoxes, otherObject);
 	}
 
 	void hit(glm::vec3 pos) override {
@@ -848,7 +1212,7 @@ public:
 	}
 
 	virtual UniformBufferObject update(GLFWwindow* window, UniformBufferObject ubo) override {
-		ubo.model = glm::mat4(1.0f);
+		ubo.model = glm::translate(glm::mat4(1.0f), _offset);
 		return ubo;
 	}
 };
@@ -856,6 +1220,7 @@ public:
 class Pig :public GameObject {
 protected:
 	HitBox_t _hitBox;
+	glm::vec3 _offset = glm::vec3(0.0f);
 
 public:
 	std::string HitBoxObj;
@@ -866,50 +1231,27 @@ public:
 	}
 
 	void loadHitBox() {
-		tinyobj::attrib_t attrib;
-		std::vector<tinyobj::shape_t> shapes;
-		std::vector<tinyobj::material_t> materials;
-		std::string warn, err;
-
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-			HitBoxObj.c_str())) {
-			throw std::runtime_error(warn + err);
-		}
-
-		//Save the vertices values in a set in order to eliminate duplicates
-		std::set<float> x, y, z;
-
-		for (int i = 0; i < attrib.vertices.size(); i = i+3)
-		{
-			x.insert(attrib.vertices[i + 0]);
-			y.insert(attrib.vertices[i + 1]);
-			z.insert(attrib.vertices[i + 2]);
-		}
-
-		//Save only first and last element of the sets 
-		_hitBox.x = glm::vec2(*x.begin(), *--x.end());
-		_hitBox.y = glm::vec2(*y.begin(), *--y.end());
-		_hitBox.z = glm::vec2(*z.begin(), *--z.end());
+		_hitBox = HitBoxRegistry::GetInstance()->get(HitBoxObj);
 	}
 
 	HitBox_t getHitBox() {
 		return _hitBox;
 	}
 
-	bool hasCollided(HitBox_t otherObject) override {
-		if (!_onScreen) {
-			return false;
-		}
-		bool x = false, y = false, z = false;
+	// Move the model and its hitbox by offset
+	void moveBy(glm::vec3 offset) {
+		_offset += offset;
+		_hitBox = moveHitBox(_hitBox, offset);
+	}
 
-		if ((otherObject.x[0] > _hitBox.x[0] && otherObject.x[0] < _hitBox.x[1]) || (otherObject.x[1] > _hitBox.x[0] && otherObject.x[1] < _hitBox.x[1]))
-			x = true;
-		if ((otherObject.y[0] > _hitBox.y[0] && otherObject.y[0] < _hitBox.y[1]) || (otherObject.y[1] > _hitBox.y[0] && otherObject.y[1] < _hitBox.y[1]))
-			y = true;
-		if ((otherObject.z[0] > _hitBox.z[0] && otherObject.z[0] < _hitBox.z[1]) || (otherObject.z[1] > _hitBox.z[0] && otherObject.z[1] < _hitBox.z[1]))
-			z = true;
+	// Become a copy of another pig moved by offset, without loading its hitbox again
+	void placeCopyOf(Pig& other, glm::vec3 offset) {
+		_offset = other._offset + offset;
+		_hitBox = moveHitBox(other._hitBox, offset);
+	}
 
-		return (x && y && z);
+	bool hasCollided(HitBox_t otherObject) override {
+		return pigCollided(_onScreen, _hitBox, otherObject);
 	}
 
 	void hit(glm::vec3 pos) override {
@@ -921,7 +1263,7 @@ public:
 	}
 
 	virtual UniformBufferObject update(GLFWwindow* window, UniformBufferObject ubo) override {
-		ubo.model = glm::mat4(1.0f);
+		ubo.model = glm::translate(glm::mat4(1.0f), _offset);
 		return ubo;
 	}
 };
@@ -958,10 +1300,10 @@ class CannonBot : public GameObject {
 	virtual UniformBufferObject update(GLFWwindow* window, UniformBufferObject ubo) override {
 		float deltaT = GameTime::GetInstance()->getDelta();
 		if (controller==CannonMovement) {
-			if (glfwGetKey(window, GLFW_KEY_A)) {
+			if (isKeyPressed(window, GLFW_KEY_A)) {
 				cannonAng.x += ROT_SPEED * deltaT;
 			}
-			if (glfwGetKey(window, GLFW_KEY_D)) {
+			if (isKeyPressed(window, GLFW_KEY_D)) {
 				cannonAng.x -= ROT_SPEED * deltaT;
 			}
 		}
@@ -1044,15 +1386,15 @@ class CannonTop : public GameObject {
 	virtual UniformBufferObject update(GLFWwindow* window, UniformBufferObject ubo) override {
 		float deltaT = GameTime::GetInstance()->getDelta();
 		if (controller==CannonMovement) {
-			if (glfwGetKey(window, GLFW_KEY_A)) {
+			if (isKeyPressed(window, GLFW_KEY_A)) {
 				cannonAng.x += ROT_SPEED * deltaT;
 				computeTrajectory();
 			}
-			if (glfwGetKey(window, GLFW_KEY_D)) {
+			if (isKeyPressed(window, GLFW_KEY_D)) {
 				cannonAng.x -= ROT_SPEED * deltaT;
 				computeTrajectory();
 			}
-			if (glfwGetKey(window, GLFW_KEY_S)) {
+			if (isKeyPressed(window, GLFW_KEY_S)) {
 				if (cannonAng.y < 25.5746f) {
 					cannonAng.y += ROT_SPEED * deltaT;
 				}
@@ -1061,7 +1403,7 @@ class CannonTop : public GameObject {
 				}
 				computeTrajectory();
 			}
-			if (glfwGetKey(window, GLFW_KEY_W)) {
+			if (isKeyPressed(window, GLFW_KEY_W)) {
 				if (cannonAng.y > -90.0f) {
 					cannonAng.y -= ROT_SPEED * deltaT;
 				}
@@ -1070,7 +1412,7 @@ class CannonTop : public GameObject {
 				}
 				computeTrajectory();
 			}
-			if (glfwGetKey(window, GLFW_KEY_Q)) {
+			if (isKeyPressed(window, GLFW_KEY_Q)) {
 				if (v0 > 5.5f) {
 					v0 -= POWER * deltaT;
 					ROT_SPEED = 600.0f / v0;
@@ -1083,7 +1425,7 @@ class CannonTop : public GameObject {
 				}
 				computeTrajectory();
 			}
-			if (glfwGetKey(window, GLFW_KEY_E)) {
+			if (isKeyPressed(window, GLFW_KEY_E)) {
 				if (v0 < 26)
 				{
 					v0 += POWER * deltaT;
@@ -1114,8 +1456,20 @@ class CannonTop : public GameObject {
 
 CannonTop *cTop;
 Text* cText;
+MemoryRegistry* cMemory;
 // MAIN ! 
 class MyProject : public BaseProject {
+public:
+	// Add count copies of the pigs and decorations to the level, to test how the game scales
+	void setStressObjects(unsigned int count) {
+		stressObjects = count;
+	}
+
+	// Load the level from another scene file instead of Assets/scenes/level.json
+	void setScene(const std::string& path) {
+		scenePath = path;
+	}
+
 protected:
 	// Here you list all the Vulkan objects you need:
 
@@ -1131,98 +1485,40 @@ protected:
 
 	// Models, textures and Descriptors (values assigned to the uniforms)
 
-	//-------------- BIRDS
-
-	Asset A_BlueBird;
-	BirdBlue birdBlue;
-
-	Asset A_RedBird;
-	BirdRed birdRed;
+	// Level read by setWindowParameters, before the descriptor pool is sized from it
+	std::string scenePath = SCENE_PATH;
+	Scene scene;
 
-	Asset A_YellowBird;
-	BirdYellow birdYellow;
-
-	Asset A_PinkBird;
-	BirdPink birdPink;
+	// Assets of the scene in file order, and the indices of the assets of every GPU timer section in draw order
+	std::vector<std::unique_ptr<Asset>> assets;
+	std::map<std::string, Asset*> assetsByName;
+	std::vector<std::pair<std::string, std::vector<size_t>>> assetGroups;
 
+	// A game object of the scene and the asset it is drawn with, the first ones match scene.objects
+	// and the effects follow
+	struct SceneInstance {
+		std::unique_ptr<GameObject> object;
+		Asset* asset;
+		bool visible;
+	};
+	std::vector<SceneInstance> instances;
 
 	std::vector<Bird *> birds;
-	int birdInCannon = 0;
-
-	//-------------- PIGS
-	Asset A_PigStd;
-	Pig pigStd;
-
-	Asset A_PigHelmet;
-	Pig pigBaloon;
-
-	Asset A_PigKingHouse;
-	Pig pigHouse;
-	
-	Asset A_PigKingShip;
-	Pig pigShip;
-
-	Asset A_PigStache;
-	Pig pigCitySky;
-
-	Asset A_PigMechanics;
-	Pig pigShipMini;
-
-	//------OTHERS
-	Asset A_CannonBot;
-	CannonBot cannonBot;
-
-	Asset A_CannonTop;
-	CannonTop cannonTop;
-
-	Asset A_Sphere;
-	WhiteSphere sphere0, sphere1, sphere2, sphere3, sphere4, sphere5, sphere6, sphere7, sphere8, sphere9;
+	std::vector<Pig*> pigs;
 	std::vector<WhiteSphere *> trajectorySpheres;
-
-
-	//----------EFFECTS
-
-	Asset A_Boom;
-	Effect* boom = new Effect(20.0f, 0.04f, 0.05f);
-
-	Asset A_Hit;
-	Effect* hit = new Effect(20.0f, 1.0f, 1.0f);
-
-	Asset A_Miss;
-	Effect* miss = new Effect(20.0f, 1.0f, 1.0f);
-
-	//Decorations Assets and GO
-	Asset A_Terrain;
-	Decoration terrain;
-
-	Asset A_TowerSiege;
-	Decoration towerSiege;
-
-	Asset A_Baloon;
-	Decoration baloon;
-
-	Asset A_SeaCity25;
-	Decoration seaCity25;
-
-	Asset A_SeaCity37;
-	Decoration seaCity37;
-
-	Asset A_ShipSmall;
-	Decoration shipSmall;
-
-	Asset A_ShipVikings;
-	Decoration shipVikings;
-
-	Asset A_SkyCity;
-	Decoration skyCity;
-
-	Asset A_GameOver;
-	Decoration gameOver;
+	CannonBot* cannonBot = nullptr;
+	CannonTop* cannonTop = nullptr;
+	Decoration* gameOver = nullptr;
+	std::map<std::string, Effect*> effects;
 
 	DescriptorSet DS_global;
 
-	std::vector<Pig*> pigs;
-	std::vector<Decoration*> decorHitBox;
+	// Stress scene: copies of the pigs and decorations of the level spread over the map
+	unsigned int stressObjects = 0;
+	std::vector<std::pair<Pig*, Asset*>> stressPigModels;
+	std::vector<std::pair<Decoration*, Asset*>> stressDecorationModels;
+	std::vector<std::unique_ptr<Pig>> stressPigs;
+	std::vector<std::unique_ptr<Decoration>> stressDecorations;
 
 	// Here you set the main application parameters
 	void setWindowParameters() {
@@ -1239,144 +1535,202 @@ protected:
 		IconImages[0].height = height;
 		IconImages[0].pixels = pixels;
 
-		// Descriptor pool sizes
-		uniformBlocksInPool = 37;	
-		texturesInPool = 36;
-		setsInPool = 37;
+		scene = loadScene(scenePath);
+
+		// Descriptor pool sizes: a set with uniform and texture for each object and effect of the scene and
+		// each stress scene object, plus text and skybox, plus the global set with only the uniform
+		uint32_t objectSets = scene.descriptorSets() + 2 + stressObjects;
+		uniformBlocksInPool = objectSets + 1;	
+		texturesInPool = objectSets;
+		setsInPool = objectSets + 1;
+
+		// GPU timer sections: frame, text, skybox, and at most a group and an asset for every asset
+		gpuTimerZones = 3 + 2 * scene.assets.size();
+	}
+
+	// Spawn count copies of the pigs and decorations at random places over the map,
+	// they reuse the assets and the hitboxes of the level but each one has its own descriptor set
+	void spawnStressScene(unsigned int count) {
+		if (stressPigModels.empty() || stressDecorationModels.empty()) {
+			throw std::runtime_error("the scene has no pigs and decorations marked for --stress!");
+		}
+
+		// Fixed seed: the same count gives the same scene on every run
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> x(-30.0f, 30.0f);
+		std::uniform_real_distribution<float> y(3.0f, 15.0f);
+		std::uniform_real_distribution<float> z(5.0f, 55.0f);
+
+		for (unsigned int i = 0; i < count; i++) {
+			glm::vec3 target = glm::vec3(x(rng), y(rng), z(rng));
+			if (i % 2 == 0) {
+				// Pigs float at a random height
+				auto model = stressPigModels[(i / 2) % stressPigModels.size()];
+				glm::vec3 center = hitBoxCenter(model.first->getHitBox());
+				stressPigs.push_back(std::make_unique<Pig>());
+				Pig* pig = stressPigs.back().get();
+				pig->placeCopyOf(*model.first, target - center);
+				pig->init(this, &DSLobj, model.second);
+				pig->showOnScreen();
+			} else {
+				// Decorations keep their height over the sea
+				auto model = stressDecorationModels[(i / 2) % stressDecorationModels.size()];
+				glm::vec3 center = hitBoxCenter(model.first->getHitBox()[0]);
+				stressDecorations.push_back(std::make_unique<Decoration>());
+				Decoration* decoration = stressDecorations.back().get();
+				decoration->placeCopyOf(*model.first, glm::vec3(target.x - center.x, 0.0f, target.z - center.z));
+				decoration->init(this, &DSLobj, model.second);
+				decoration->showOnScreen();
+			}
+		}
+		GameMaster::GetInstance()->addPigs(stressPigs.size());
+		std::cout << "Stress scene: " << stressPigs.size() << " pigs and " << stressDecorations.size() << " decorations\n";
+	}
+
+	// Create the assets and the game objects declared by the scene, nothing is loaded yet
+	void createScene() {
+		for (const SceneAsset& sceneAsset : scene.assets) {
+			assets.push_back(std::make_unique<Asset>());
+			assetsByName[sceneAsset.name] = assets.back().get();
+
+			auto group = std::find_if(assetGroups.begin(), assetGroups.end(),
+				[&](const std::pair<std::string, std::vector<size_t>>& g) { return g.first == sceneAsset.group; });
+			if (group == assetGroups.end()) {
+				assetGroups.push_back({ sceneAsset.group, {} });
+				group = assetGroups.end() - 1;
+			}
+			group->second.push_back(assets.size() - 1);
+		}
+
+		for (const SceneObject& sceneObject : scene.objects) {
+			Asset* asset = assetsByName[sceneObject.asset];
+			std::unique_ptr<GameObject> object;
+			switch (sceneObject.type) {
+			case SCENE_BIRD:
+				birds.push_back(new Bird());
+				object.reset(birds.back());
+				break;
+			case SCENE_PIG:
+				pigs.push_back(new Pig());
+				object.reset(pigs.back());
+				if (sceneObject.stress) {
+					stressPigModels.push_back({ pigs.back(), asset });
+				}
+				break;
+			case SCENE_DECORATION:
+				object.reset(new Decoration());
+				if (sceneObject.stress) {
+					stressDecorationModels.push_back({ (Decoration*)object.get(), asset });
+				}
+				break;
+			case SCENE_CANNON_BOT:
+				cannonBot = new CannonBot();
+				object.reset(cannonBot);
+				break;
+			case SCENE_CANNON_TOP:
+				cannonTop = new CannonTop();
+				object.reset(cannonTop);
+				break;
+			case SCENE_TRAJECTORY:
+				trajectorySpheres.push_back(new WhiteSphere());
+				object.reset(trajectorySpheres.back());
+				break;
+			case SCENE_GAME_OVER:
+				gameOver = new Decoration();
+				object.reset(gameOver);
+				break;
+			}
+			instances.push_back({ std::move(object), asset, sceneObject.visible });
+		}
+
+		for (const SceneEffect& sceneEffect : scene.effects) {
+			Effect* effect = new Effect(sceneEffect.rotationSpeed, sceneEffect.scaleSpeed, sceneEffect.maxScale);
+			effects[sceneEffect.role] = effect;
+			instances.push_back({ std::unique_ptr<GameObject>(effect), assetsByName[sceneEffect.asset], false });
+		}
 	}
 
 	void setGameState() {
 		//set up callback for input
-		cTop = &cannonTop;
+		cTop = cannonTop;
 		cText = &text;
+		cMemory = &memoryRegistry;
 
-		glfwSetKeyCallback(window, keyCallback);
+		if (window != nullptr) {
+			glfwSetKeyCallback(window, keyCallback);
+		}
 
 		Camera::GetInstance()->NextView();
 
 		// -------------- Load BIRDS in the cannon
-		birds.push_back(&birdBlue);
-		birds.push_back(&birdRed);
-		birds.push_back(&birdYellow);
-		birds.push_back(&birdPink);
-
-		cannonTop.setBirds(&birds);
-		cannonTop.setBirdReady();
-		cannonTop.setBirdLoaded(0);
-		cannonTop.setBot(&cannonBot);
+		cannonTop->setBirds(&birds);
+		cannonTop->setBirdReady();
+		cannonTop->setBirdLoaded(0);
+		cannonTop->setBot(cannonBot);
 
-		GameMaster::GetInstance()->setCannon(&cannonTop);
+		GameMaster::GetInstance()->setCannon(cannonTop);
 
 		// ------------ Trajectory
-		trajectorySpheres.push_back(&sphere0);
-		trajectorySpheres.push_back(&sphere1);
-		trajectorySpheres.push_back(&sphere2);
-		trajectorySpheres.push_back(&sphere3);
-		trajectorySpheres.push_back(&sphere4);
-		trajectorySpheres.push_back(&sphere5);
-		trajectorySpheres.push_back(&sphere6);
-		trajectorySpheres.push_back(&sphere7);
-		trajectorySpheres.push_back(&sphere8);
-		trajectorySpheres.push_back(&sphere9);
-		cannonTop.setTrajectory(&trajectorySpheres);
-		cannonTop.computeTrajectory();
+		cannonTop->setTrajectory(&trajectorySpheres);
+		cannonTop->computeTrajectory();
 
 		//----------- Effects
-		GameMaster::GetInstance()->setBoomEffect(boom);
-		GameMaster::GetInstance()->setHitEffect(hit);
-		GameMaster::GetInstance()->setMissEffect(miss);
-		GameMaster::GetInstance()->setGameOver(&gameOver);
+		GameMaster::GetInstance()->setBoomEffect(effects["boom"]);
+		GameMaster::GetInstance()->setHitEffect(effects["hit"]);
+		GameMaster::GetInstance()->setMissEffect(effects["miss"]);
+		GameMaster::GetInstance()->setGameOver(gameOver);
 
 		//-------------Pigs
-		pigs.push_back(&pigBaloon);
-		pigs.push_back(&pigShip);
-		pigs.push_back(&pigShipMini);
-		pigs.push_back(&pigCitySky);
-		pigs.push_back(&pigHouse);
-		pigs.push_back(&pigStd);
-		
+		GameMaster::GetInstance()->addPigs(pigs.size());
 	}
 
 	void loadHitBoxes() {
+		StartupZone zone("MyProject::loadHitBoxes", "Hit boxes");
 
-		pigStd.setHitBox(MODEL_PATH + "/PigCustom/PigStandardHB.obj");
-
-		pigBaloon.setHitBox(MODEL_PATH + "/PigCustom/PigHelmetHB.obj");
-
-		pigHouse.setHitBox(MODEL_PATH + "/PigCustom/PigKingHouseHB.obj");
-
-		pigShip.setHitBox(MODEL_PATH + "/PigCustom/PigKingBoatHB.obj");
-
-		pigCitySky.setHitBox(MODEL_PATH + "/PigCustom/PigStacheHB.obj");
-
-		pigShipMini.setHitBox(MODEL_PATH + "/PigCustom/PigMechanicHB.obj");
-
-		birdBlue.setHitBox(MODEL_PATH + "/Birds/bluesHitBox.obj");
-
-		birdRed.setHitBox(MODEL_PATH + "/Birds/bluesHitBox.obj");
-		birdYellow.setHitBox(MODEL_PATH + "/Birds/bluesHitBox.obj");
-		birdPink.setHitBox(MODEL_PATH + "/Birds/bluesHitBox.obj");
-
-
-		// --------------------- MAP
-
-		std::vector<std::string> terrainHitBoxes;
-		terrainHitBoxes.push_back(HITBOXDEC_PATH + "/Far.obj");
-		terrainHitBoxes.push_back(HITBOXDEC_PATH + "/Near.obj");
-		terrainHitBoxes.push_back(HITBOXDEC_PATH + "/Right.obj");
-		terrainHitBoxes.push_back(HITBOXDEC_PATH + "/Left.obj");
-		terrainHitBoxes.push_back(HITBOXDEC_PATH + "/Sky.obj");
-		terrainHitBoxes.push_back(HITBOXDEC_PATH + "/Sea.obj");
-		terrainHitBoxes.push_back(HITBOXDEC_PATH + "/Rock1.obj");
-		terrainHitBoxes.push_back(HITBOXDEC_PATH + "/Rock2.obj");
-		terrainHitBoxes.push_back(HITBOXDEC_PATH + "/Grass.obj");
-		terrain.setHitBoxes(terrainHitBoxes);
-
-
-		std::vector<std::string> towerHitBoxes;
-		towerHitBoxes.push_back(HITBOXDEC_PATH + "/TowerBody.obj");
-		towerHitBoxes.push_back(HITBOXDEC_PATH + "/TowerPlatform.obj");
-		towerHitBoxes.push_back(HITBOXDEC_PATH + "/TowerRoof.obj");
-		towerSiege.setHitBoxes(towerHitBoxes);
-
-
-		std::vector<std::string> cityHitBox;
-		cityHitBox.push_back(HITBOXDEC_PATH + "/HouseBot.obj");
-		cityHitBox.push_back(HITBOXDEC_PATH + "/HouseTop.obj");
-		seaCity25.setHitBoxes(cityHitBox);
-
-
-		std::vector<std::string> skyCityHitBoxes;
-		skyCityHitBoxes.push_back(HITBOXDEC_PATH + "/SkyCityMid.obj");
-		skyCityHitBoxes.push_back(HITBOXDEC_PATH + "/SkyCityTop.obj");
-		skyCityHitBoxes.push_back(HITBOXDEC_PATH + "/SkyCityBot.obj");
-		skyCity.setHitBoxes(skyCityHitBoxes);
-
-
-		std::vector<std::string> baloonHitBoxs;
-		baloonHitBoxs.push_back(HITBOXDEC_PATH + "/BaloonBot.obj");
-		baloonHitBoxs.push_back(HITBOXDEC_PATH + "/BaloonMid.obj");
-		baloonHitBoxs.push_back(HITBOXDEC_PATH + "/BaloonTop.obj");
-		baloon.setHitBoxes(baloonHitBoxs);
-
-	
-		std::vector<std::string> shipSmallHitBox;
-		shipSmallHitBox.push_back(HITBOXDEC_PATH + "/BoatMini.obj");
-		shipSmall.setHitBoxes(shipSmallHitBox);
-
-
-		std::vector<std::string> shipVikingsHitBox;
-		shipVikingsHitBox.push_back(HITBOXDEC_PATH + "/BoatVikings.obj");
-		shipVikings.setHitBoxes(shipVikingsHitBox);
-
+		for (size_t i = 0; i < scene.objects.size(); i++) {
+			const SceneObject& sceneObject = scene.objects[i];
+			GameObject* object = instances[i].object.get();
+			if (sceneObject.type == SCENE_BIRD) {
+				((Bird*)object)->setHitBox(MODEL_PATH + sceneObject.hitBoxes[0]);
+			}
+			else if (sceneObject.type == SCENE_PIG) {
+				Pig* pig = (Pig*)object;
+				pig->setHitBox(MODEL_PATH + sceneObject.hitBoxes[0]);
+				pig->moveBy(sceneObject.offset);
+			}
+			else if (sceneObject.type == SCENE_DECORATION) {
+				std::vector<std::string> hitBoxes;
+				for (const std::string& hitBox : sceneObject.hitBoxes) {
+					hitBoxes.push_back(MODEL_PATH + hitBox);
+				}
+				Decoration* decoration = (Decoration*)object;
+				decoration->setHitBoxes(hitBoxes);
+				decoration->moveBy(sceneObject.offset);
+			}
+		}
 
+		HitBoxRegistry::GetInstance()->save();
 	}
 
 	// Here you load and setup all your Vulkan objects, this function is called before the creation of command buffers and sync objects
 	void localInit() {
 
+		createScene();
 		setGameState();
 
+		// The SPIR-V of the compact shader is built by shaders/compiler.bat
+		if (usesCompactVertices() && !std::filesystem::exists(COMPACT_MATERIAL_SHADER)) {
+			std::cout << "warning: --compact-vertices is IGNORED, " << COMPACT_MATERIAL_SHADER << " not found: the models are "
+					  << "loaded with full 32 byte vertices. Compile shaders/materialCompactShader.vert with shaders/compiler.bat "
+					  << "(or glslc materialCompactShader.vert -o materialCompactVert.spv in shaders) first\n";
+			setCompactVertices(false);
+		}
+
+		// Models and textures of the whole scene: they are read by the loading threads while the main thread creates the rest
+		for (size_t i = 0; i < scene.assets.size(); i++) {
+			assets[i]->init(this, scene.assets[i].model, scene.assets[i].texture, &DSLobj);
+		}
+
 		loadHitBoxes();
 
 		// Descriptor Layouts [what will be passed to the shaders]
@@ -1395,148 +1749,44 @@ protected:
 		// Pipelines [Shader couples]
 		// The last array, is a vector of pointer to the layouts of the sets that will
 		// be used in this pipeline. The first element will be set 0, and so on..
-		P1.init(this, "shaders/materialVert.spv", "shaders/materialFrag.spv", { &DSLglobal, &DSLobj });
-
-
-		// Models, textures and Descriptors (values assigned to the uniforms)
-		A_BlueBird.init(this, "/Birds/blues.obj", "/texture.png", &DSLobj);
-		birdBlue.init(this, &DSLobj, &A_BlueBird);
-
-		A_RedBird.init(this, "/Birds/red.obj", "/texture.png", &DSLobj);
-		birdRed.init(this, &DSLobj, &A_RedBird);
-
-		A_YellowBird.init(this, "/Birds/chuck.obj", "/texture.png", &DSLobj);
-		birdYellow.init(this, &DSLobj, &A_YellowBird);
-
-		A_PinkBird.init(this, "/Birds/stella.obj", "/texture.png", &DSLobj);
-		birdPink.init(this, &DSLobj, &A_PinkBird);
-
-		A_PigStd.init(this, "/PigCustom/PigStandard.obj", "/texture.png", &DSLobj);
-		pigStd.init(this, &DSLobj, &A_PigStd);
-
-		A_PigHelmet.init(this, "/PigCustom/PigHelmet.obj", "/texture.png", &DSLobj);
-		pigBaloon.init(this, &DSLobj, &A_PigHelmet);
-
-		A_PigKingHouse.init(this, "/PigCustom/PigKingHouse.obj", "/texture.png", &DSLobj);
-		pigHouse.init(this, &DSLobj, &A_PigKingHouse);
-
-		A_PigKingShip.init(this, "/PigCustom/PigKingBoat.obj", "/texture.png", &DSLobj);
-		pigShip.init(this, &DSLobj, &A_PigKingShip);
-
-		A_PigMechanics.init(this, "/PigCustom/PigMechanic.obj", "/texture.png", &DSLobj);
-		pigShipMini.init(this, &DSLobj, &A_PigMechanics);
-
-		A_PigStache.init(this, "/PigCustom/PigStache.obj", "/texture.png", &DSLobj);
-		pigCitySky.init(this, &DSLobj, &A_PigStache);
-
-		for (Pig* p : pigs) {
-			p->showOnScreen();
+		if (usesCompactVertices()) {
+			P1.init(this, COMPACT_MATERIAL_SHADER, "shaders/materialFrag.spv", { &DSLglobal, &DSLobj }, VERTEX_COMPACT);
+		} else {
+			P1.init(this, "shaders/materialVert.spv", "shaders/materialFrag.spv", { &DSLglobal, &DSLobj });
 		}
 
-		A_Terrain.init(this, "/Terrain/Terrain.obj", "/Terrain/terrain.png", &DSLobj);
-		terrain.init(this, &DSLobj, &A_Terrain);
-		terrain.showOnScreen();
-
-		A_CannonBot.init(this, "/Cannon/BotCannon.obj", "/Cannon/map_CP_001.001_BaseColorRedBird.png", &DSLobj);
-		cannonBot.init(this, &DSLobj, &A_CannonBot);
-		cannonBot.showOnScreen();
-
-		A_CannonTop.init(this, "/Cannon/TopCannon.obj", "/Cannon/map_CP_001.001_BaseColorRedBird.png", &DSLobj);
-		cannonTop.init(this, &DSLobj, &A_CannonTop);
-		cannonTop.showOnScreen();
 
-		A_Sphere.init(this, "/Cannon/Trajectory.obj", "/Cannon/Trajectory.png", &DSLobj);
-		for (WhiteSphere *block : trajectorySpheres) {
-			block->init(this, &DSLobj, &A_Sphere);
-			block->showOnScreen();
+		// Descriptors (values assigned to the uniforms), each one waits for the loading of its asset
+		for (SceneInstance& instance : instances) {
+			instance.object->init(this, &DSLobj, instance.asset);
+			if (instance.visible) {
+				instance.object->showOnScreen();
+			}
 		}
 
-		A_TowerSiege.init(this, "/Decorations/TowerSiege.obj", "/Decorations/TowerSiege.png", &DSLobj);
-		towerSiege.init(this, &DSLobj, &A_TowerSiege);
-		towerSiege.showOnScreen();
-
-		A_Baloon.init(this, "/Decorations/Baloon.obj", "/Decorations/Baloon.png", &DSLobj);
-		baloon.init(this, &DSLobj, &A_Baloon);
-		baloon.showOnScreen();
-
-		A_SeaCity25.init(this, "/Decorations/SeaCity25.obj", "/Decorations/SeaCity25.png", &DSLobj);
-		seaCity25.init(this, &DSLobj, &A_SeaCity25);
-		seaCity25.showOnScreen();
-
-		A_SeaCity37.init(this, "/Decorations/SeaCity37.obj", "/Decorations/SeaCity37.png", &DSLobj);
-		seaCity37.init(this, &DSLobj, &A_SeaCity37);
-		seaCity37.showOnScreen();
-
-		A_ShipSmall.init(this, "/Decorations/ShipSmall.obj", "/Decorations/ShipSmall.png", &DSLobj);
-		shipSmall.init(this, &DSLobj, &A_ShipSmall);
-		shipSmall.showOnScreen();
-
-		A_ShipVikings.init(this, "/Decorations/ShipVikings.obj", "/Decorations/ShipVikings.png", &DSLobj);
-		shipVikings.init(this, &DSLobj, &A_ShipVikings);
-		shipVikings.showOnScreen();
-
-		A_SkyCity.init(this, "/Decorations/SkyCity.obj", "/Decorations/SkyCity.png", &DSLobj);
-		skyCity.init(this, &DSLobj, &A_SkyCity);
-		skyCity.showOnScreen();
-
-		A_Boom.init(this, "/Effects/Boom.obj", "/Effects/boom_lambert1_BaseColor.jpeg", &DSLobj);
-		boom->init(this, &DSLobj, &A_Boom);
-
-		A_Hit.init(this, "/Effects/OK.obj", "/Effects/Ok_Texture.png", &DSLobj);
-		hit->init(this, &DSLobj, &A_Hit);
-
-		A_Miss.init(this, "/Effects/NO.obj", "/Effects/NO_Texture.png", &DSLobj);
-		miss->init(this, &DSLobj, &A_Miss);
-
-		A_GameOver.init(this, "/Decorations/GameOver.obj", "/Decorations/GameOver1.png", &DSLobj);
-		gameOver.init(this, &DSLobj, &A_GameOver);
-
-		skyBox.init(this, DSLobj, DSLglobal);
-		text.init(this, DSLobj, DSLglobal);
+		skyBox.init(this, &DSLobj, &DSLglobal);
+		text.init(this, &DSLobj, &DSLglobal);
 
 
 		DS_global.init(this, &DSLglobal, {
 		{0, UNIFORM, sizeof(GlobalUniformBufferObject), nullptr},
 			});
+
+		if (stressObjects > 0) {
+			spawnStressScene(stressObjects);
+		}
 	}
 
 	// Here you destroy all the objects you created!		
 	void localCleanup() {
 
-		A_BlueBird.cleanup();
-		A_RedBird.cleanup();
-		A_YellowBird.cleanup();
-		A_PinkBird.cleanup();
-
-		A_PigStd.cleanup();
-		A_PigHelmet.cleanup();
-		A_PigKingHouse.cleanup();
-		A_PigKingShip.cleanup();
-		A_PigMechanics.cleanup();
-		A_PigStache.cleanup();
-
-		A_Terrain.cleanup();
-
-		A_CannonBot.cleanup();
-
-		A_CannonTop.cleanup();
+		InputReplay::GetInstance()->stop();
+		FrameStats::GetInstance()->stop();
 
-		A_Sphere.cleanup();
-
-		//Effects
-		A_Boom.cleanup();
-		A_Hit.cleanup();
-		A_Miss.cleanup();
-
-		//Decorations
-		A_Baloon.cleanup();
-		A_SeaCity25.cleanup();
-		A_SeaCity37.cleanup();
-		A_ShipSmall.cleanup();
-		A_ShipVikings.cleanup();
-		A_TowerSiege.cleanup();
-		A_SkyCity.cleanup();
-		A_GameOver.cleanup();
+		// The assets clean the descriptor sets of their objects
+		for (std::unique_ptr<Asset>& asset : assets) {
+			asset->cleanup();
+		}
 
 		skyBox.cleanup();
 		text.cleanup();
@@ -1550,17 +1800,29 @@ protected:
 		DSLobj.cleanup();
 	}
 
+	// Hot reload: the assets using the changed model or texture
+	bool localPrepareReload(const std::string& file, std::vector<std::function<void()>>& swaps) {
+		bool used = false;
+		for (std::unique_ptr<Asset>& asset : assets) {
+			used = asset->prepareReload(file, swaps) || used;
+		}
+		return used;
+	}
+
 	// Here it is the creation of the command buffer:
 	// You send to the GPU all the objects you want to draw,
 	// with their buffers and textures
 	void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
 
-
+		int zone = gpuTimer.beginZone(commandBuffer, currentImage, "Text");
 		text.populateCommandBuffer(commandBuffer, currentImage, DS_global);
+		gpuTimer.endZone(commandBuffer, currentImage, zone);
 
 		// --------------------- SKYBOX -------------------------
 
+		zone = gpuTimer.beginZone(commandBuffer, currentImage, "SkyBox");
 		skyBox.populateCommandBuffer(commandBuffer, currentImage, DS_global);
+		gpuTimer.endZone(commandBuffer, currentImage, zone);
 
 
 		// -------------------- Pipeline 1 -----------------------------
@@ -1575,56 +1837,29 @@ protected:
 			0, nullptr);
 
 
-		// ---------------------- BIRD BLUES ------------
-
-		A_BlueBird.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_RedBird.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_YellowBird.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_PinkBird.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-
-		// ------------------------ PIG --------------------
-
-		A_PigStd.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_PigHelmet.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_PigKingHouse.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_PigKingShip.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_PigMechanics.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_PigStache.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-
-		// ------------------------ Terrain -----------------
-
-		A_Terrain.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-
-		// ----------------------- Cannon -------------------
-
-		A_CannonBot.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_CannonTop.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-
-		// ----------------------- Trajectory -------------------
-
-		A_Sphere.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-
-		 // ----------------------- DECORATIONS --------------------
-		 A_Baloon.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		 A_SeaCity25.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		 A_SeaCity37.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		 A_ShipSmall.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		 A_ShipVikings.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		 A_TowerSiege.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		 A_SkyCity.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		 A_GameOver.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-
-		// ---------------------- EFFECTS -----------------------------
-		A_Boom.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_Hit.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
-		A_Miss.populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
+		// One GPU timer section for every group of assets of the scene, and inside it one for every asset,
+		// named group/asset so that an asset named like its group gets its own entry
+		for (auto const& group : assetGroups) {
+			zone = gpuTimer.beginZone(commandBuffer, currentImage, group.first);
+			for (size_t index : group.second) {
+				int assetZone = gpuTimer.beginZone(commandBuffer, currentImage, group.first + "/" + scene.assets[index].name);
+				assets[index]->populateCommandBuffer(commandBuffer, currentImage, DS_global, &P1);
+				gpuTimer.endZone(commandBuffer, currentImage, assetZone);
+			}
+			gpuTimer.endZone(commandBuffer, currentImage, zone);
+		}
 	}
 
 	// Here is where you update the uniforms.
 	// Very likely this will be where you will be writing the logic of your application.
 	void updateUniformBuffer(uint32_t currentImage) {
 
-		GameTime::GetInstance()->setTime();
+		// Updates GameTime and the input, either live or from a recording
+		InputReplay::GetInstance()->beginFrame(window);
+		if (InputReplay::GetInstance()->isFinished()) {
+			stopRequested = true;
+		}
+		FrameStats::GetInstance()->frame();
 
 
 		UniformBufferObject ubo{};
@@ -1656,28 +1891,36 @@ protected:
 
 
 		// ------------------------------ COLLISION
-		GameMaster::GetInstance()->handleCollision(cannonTop.getCurrentBird());
+		GameMaster::GetInstance()->handleCollision(cannonTop->getCurrentBird());
 	}
 
 
 };
 
 void GameMaster::handleCollision(Bird* movingObject) {
+	TRACE_ZONE("GameMaster::handleCollision");
 	HitBox_t hitBoxMove = movingObject->getHitBox();
-	for (auto const& obj : onScene) {
-		if (obj->hasCollided(hitBoxMove)) {
-			obj->hit(movingObject->getPosition());
-			movingObject->hit(movingObject->getPosition());
-			((CannonTop *)cannon)->setNextBird();
-			return;
-		}
+	GameObject* obj = firstCollided(onScene, hitBoxMove);
+	if (obj != nullptr) {
+		obj->hit(movingObject->getPosition());
+		movingObject->hit(movingObject->getPosition());
+		((CannonTop *)cannon)->setNextBird();
 	}
 }
 
 //calbacks inputs
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-	
+	// During a replay the keyboard is ignored, the events come from the recording
+	if (InputReplay::GetInstance()->isReplaying()) {
+		return;
+	}
+	InputReplay::GetInstance()->recordKey(key, action);
+	handleKey(key, action);
+}
+
+void handleKey(int key, int action)
+{
 	if (key == GLFW_KEY_X && action == GLFW_PRESS)
 	{
 		cameraON = !cameraON;
@@ -1703,6 +1946,10 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 	if (key == GLFW_KEY_L && action == GLFW_PRESS) {
 		Camera::GetInstance()->ShowStat();
 	}
+	//to print the device memory used by each subsystem
+	if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+		cMemory->dump();
+	}
 	if (key == GLFW_KEY_1 && action == GLFW_PRESS) {
 		Camera::GetInstance()->SetView(1);
 	}
@@ -1724,10 +1971,102 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 
 
 // This is the main: probably you do not need to touch this!
-int main() {
+// Options:
+//   --headless <frames>   render offscreen (no window) for the given number of frames and print the frame rate,
+//                         0 runs until the end of the replay (needs --replay)
+//   --record <file>       record the input and the frame times of the session
+//   --replay <file>       play back a recorded session instead of reading the keyboard, then quit
+//   --fixed-step <dt>     advance the game time of exactly dt seconds per frame
+//   --gpu-timing <file>   measure the GPU time of each render section and save it as JSON
+//   --trace <file>        record the CPU time of the frame phases as a Chrome trace
+//   --startup-profile <file>  print the time spent loading every asset and save it to file
+//   --frame-stats <seconds>   log the frame time percentiles and hitches every interval (0 = only at exit)
+//   --scene <file>        load the level from a scene file instead of Assets/scenes/level.json
+//   --stress <count>      spawn count more pigs and decorations across the map
+//   --no-mesh-cache       always parse the OBJ models and hitboxes instead of using the binary caches in MeshCache/
+//   --no-mesh-optimization  keep the triangles and vertices of the OBJ models in the order they were exported
+//   --loading-threads <n> parse models and decode textures on n threads (default: one per core, 0 = main thread)
+//   --no-compressed-textures  ignore the BC textures built by Tools/TextureCompiler and decode the images
+//   --compact-vertices    draw the assets with 16 byte quantized vertices (needs shaders/materialCompactVert.spv)
+//   --no-transfer-queue   upload through the graphics queue even when the GPU has a transfer only queue
+//   --staging-size <MB>   size of the staging ring used by the uploads (default 64)
+//   --hot-reload          load again the models, textures and shaders changed on disk while the game runs
+int main(int argc, char* argv[]) {
 	MyProject app;
 
 	try {
+		// Only the end of a replay stops a headless run of 0 frames
+		bool headlessUntilReplayEnd = false;
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (arg == "--headless" && i + 1 < argc) {
+				unsigned long frames = std::stoul(argv[++i]);
+				app.setHeadless(frames);
+				headlessUntilReplayEnd = frames == 0;
+			}
+			else if (arg == "--record" && i + 1 < argc) {
+				InputReplay::GetInstance()->startRecording(argv[++i]);
+			}
+			else if (arg == "--replay" && i + 1 < argc) {
+				InputReplay::GetInstance()->startReplay(argv[++i]);
+			}
+			else if (arg == "--fixed-step" && i + 1 < argc) {
+				GameTime::GetInstance()->setFixedStep(std::stof(argv[++i]));
+			}
+			else if (arg == "--gpu-timing" && i + 1 < argc) {
+				app.setGpuTiming(argv[++i]);
+			}
+			else if (arg == "--trace" && i + 1 < argc) {
+				Tracer::GetInstance()->start(argv[++i]);
+			}
+			else if (arg == "--startup-profile" && i + 1 < argc) {
+				StartupProfiler::GetInstance()->start(argv[++i]);
+			}
+			else if (arg == "--frame-stats" && i + 1 < argc) {
+				FrameStats::GetInstance()->start(std::stof(argv[++i]));
+			}
+			else if (arg == "--scene" && i + 1 < argc) {
+				app.setScene(argv[++i]);
+			}
+			else if (arg == "--stress" && i + 1 < argc) {
+				int count = std::stoi(argv[++i]);
+				if (count < 0) {
+					throw std::runtime_error("--stress needs a count of 0 or more");
+				}
+				app.setStressObjects(count);
+			}
+			else if (arg == "--no-mesh-cache") {
+				MeshCache::GetInstance()->setEnabled(false);
+			}
+			else if (arg == "--no-mesh-optimization") {
+				MeshCache::GetInstance()->setOptimization(false);
+			}
+			else if (arg == "--loading-threads" && i + 1 < argc) {
+				app.setLoadingThreads(std::stoul(argv[++i]));
+			}
+			else if (arg == "--no-compressed-textures") {
+				app.setCompressedTextures(false);
+			}
+			else if (arg == "--compact-vertices") {
+				app.setCompactVertices(true);
+			}
+			else if (arg == "--no-transfer-queue") {
+				app.setTransferQueue(false);
+			}
+			else if (arg == "--staging-size" && i + 1 < argc) {
+				app.setStagingSize(std::stoull(argv[++i]) * 1024 * 1024);
+			}
+			else if (arg == "--hot-reload") {
+				app.setHotReload(true);
+			}
+			else {
+				throw std::runtime_error("unknown or incomplete option: " + arg);
+			}
+		}
+		if (headlessUntilReplayEnd && !InputReplay::GetInstance()->isReplaying()) {
+			throw std::runtime_error("--headless 0 needs --replay, otherwise it never stops");
+		}
+
 		app.run();
 	}
 	catch (const std::exception& e) {
@@ -20,8 +20,25 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <chrono>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+
+#include <json.hpp>
+
+#include "Tracer.hpp"
+#include "StartupProfiler.hpp"
+#include "MeshCache.hpp"
+#include "ThreadPool.hpp"
+#include "TextureContainer.hpp"
+#include "MeshOptimizer.hpp"
+#include "FileWatcher.hpp"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
@@ -30,6 +47,20 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+// Binary glTF models, their images are decoded by Texture
+#define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NO_STB_IMAGE
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+// Its JSON parser does not handle the binary values of the newer json.hpp in a switch
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch"
+#endif
+#include <tiny_gltf.h>
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
 //
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
@@ -81,13 +112,102 @@ struct Vertex {
 						
 		return attributeDescriptions;
 	}
+
+	bool operator==(const Vertex& other) const {
+		return pos == other.pos && norm == other.norm && texCoord == other.texCoord;
+	}
+};
+
+// 16 byte vertex for the meshes drawn with VERTEX_COMPACT pipelines: 16-bit position inside the box of the
+// mesh, octahedral normal in two 16-bit components and half float texture coordinates (expected to stay
+// within a few units, where a half float is still precise to a fraction of a texel)
+struct CompactVertex {
+	uint16_t pos[4];
+	int16_t norm[2];
+	uint16_t texCoord[2];
+
+	static CompactVertex encode(const Vertex& vertex, glm::vec3 offset, glm::vec3 scale) {
+		CompactVertex compact{};
+		for (int i = 0; i < 3; i++) {
+			float t = scale[i] > 0.0f ? (vertex.pos[i] - offset[i]) / scale[i] : 0.0f;
+			compact.pos[i] = (uint16_t)std::lround(glm::clamp(t, 0.0f, 1.0f) * 65535.0f);
+		}
+
+		// Project on the octahedron |x| + |y| + |z| = 1, then fold the lower half over the upper one
+		glm::vec3 n = vertex.norm;
+		float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		glm::vec2 octahedral = length > 0.0f ? glm::vec2(n.x, n.y) / length : glm::vec2(0.0f);
+		if (n.z < 0.0f) {
+			octahedral = glm::vec2((1.0f - std::abs(octahedral.y)) * (octahedral.x >= 0.0f ? 1.0f : -1.0f),
+								   (1.0f - std::abs(octahedral.x)) * (octahedral.y >= 0.0f ? 1.0f : -1.0f));
+		}
+		compact.norm[0] = (int16_t)std::lround(glm::clamp(octahedral.x, -1.0f, 1.0f) * 32767.0f);
+		compact.norm[1] = (int16_t)std::lround(glm::clamp(octahedral.y, -1.0f, 1.0f) * 32767.0f);
+
+		compact.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+		compact.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+		return compact;
+	}
+
+	static VkVertexInputBindingDescription getBindingDescription() {
+		VkVertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(CompactVertex);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		
+		return bindingDescription;
+	}
+	
+	static std::array<VkVertexInputAttributeDescription, 3>
+						getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 3>
+						attributeDescriptions{};
+		
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+		attributeDescriptions[0].offset = offsetof(CompactVertex, pos);
+						
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 1;
+		attributeDescriptions[1].format = VK_FORMAT_R16G16_SNORM;
+		attributeDescriptions[1].offset = offsetof(CompactVertex, norm);
+		
+		attributeDescriptions[2].binding = 0;
+		attributeDescriptions[2].location = 2;
+		attributeDescriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+		attributeDescriptions[2].offset = offsetof(CompactVertex, texCoord);
+						
+		return attributeDescriptions;
+	}
+};
+
+// Push constant of the VERTEX_COMPACT pipelines: position = offset + pos * scale
+struct MeshQuantization {
+	glm::vec4 offset;
+	glm::vec4 scale;
 };
 
+enum VertexFormat {VERTEX_FULL, VERTEX_COMPACT};
+
+// Used to find the duplicated vertices when loading a model
+namespace std {
+	template<> struct hash<Vertex> {
+		size_t operator()(Vertex const& vertex) const {
+			return ((hash<glm::vec3>()(vertex.pos) ^
+				   (hash<glm::vec3>()(vertex.norm) << 1)) >> 1) ^
+				   (hash<glm::vec2>()(vertex.texCoord) << 1);
+		}
+	};
+}
+
 
 // Lesson 13
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	// Family that can copy but not draw, it uploads in parallel with the rendering (optional)
+	std::optional<uint32_t> transferFamily;
 
 	bool isComplete() {
 		return graphicsFamily.has_value() &&
@@ -179,18 +299,50 @@ class BaseProject;
 
 struct Model {
 	BaseProject *BP;
+	// Empty when the model comes from the mesh cache, use the counts to draw
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	glm::vec3 aabbMin = glm::vec3(0.0f);
+	glm::vec3 aabbMax = glm::vec3(0.0f);
 	VkBuffer vertexBuffer;
 	VkDeviceMemory vertexBufferMemory;
 	VkBuffer indexBuffer;
 	VkDeviceMemory indexBufferMemory;
+	// Kept between load() and upload() when the arrays are copied straight from the mesh cache
+	// or from the glTF buffers (sourceData keeps them alive), otherwise the vectors are used
+	std::string sourceFile;
+	std::shared_ptr<void> sourceData;
+	const void* vertexSource = nullptr;
+	const void* indexSource = nullptr;
+	const char* uploadPhase = "Mesh upload";
+	// Size of the vertices in the buffer, sizeof(CompactVertex) after quantize()
+	uint32_t vertexStride = sizeof(Vertex);
+	bool quantized = false;
+	std::vector<CompactVertex> compactVertices;
+	// VK_INDEX_TYPE_UINT16 when every vertex can be addressed with 16 bits, the indices are then in shortIndices
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	std::vector<uint16_t> shortIndices;
+	// PNG/JPEG bytes of the base color texture of a glTF model, empty if it has none
+	std::vector<unsigned char> embeddedTexture;
 	
 	void loadModel(std::string file);
+	void loadGLTF(std::string file);
+	void optimize();
+	void narrowIndices();
+	uint32_t indexSize();
+	void quantize();
+	MeshQuantization getQuantization();
 	void loadText(std::vector<std::string> SceneText);
 	void createIndexBuffer();
+	void createIndexBuffer(const void* src);
 	void createVertexBuffer();
+	void createVertexBuffer(const void* src);
 
+	// load() touches only the CPU and can run on a loading thread, upload() must run on the main thread
+	void load(std::string file);
+	void upload(BaseProject *bp);
 	void init(BaseProject *bp, std::string file);
 	void initText(BaseProject* bp, std::vector<std::string> SceneText);
 	void cleanup();
@@ -203,15 +355,55 @@ struct Texture {
 	VkDeviceMemory textureImageMemory;
 	VkImageView textureImageView;
 	VkSampler textureSampler;
+	VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+	// Decoded image or mapped container kept between load() and upload()
+	std::string sourceFile;
+	stbi_uc* pixels = nullptr;
+	int texWidth = 0;
+	int texHeight = 0;
+	std::shared_ptr<MappedFile> container;
+	const TextureContainerHeader* containerHeader = nullptr;
 	
-	void createTextureImage(std::string file);
+	void createTextureImage();
+	void createCompressedTextureImage();
 	void createTextureImageView();
 	void createTextureSampler();
 
+	// load() touches only the CPU and can run on a loading thread, upload() must run on the main thread.
+	// With compressed the prebuilt container of the file is used when there is one
+	void load(std::string file, bool compressed = false);
+	// Decode an image already in memory, e.g. embedded in a glTF model, name is used only by the profiler
+	void loadFromMemory(std::string name, const std::vector<unsigned char>& encoded);
+	void upload(BaseProject *bp);
 	void init(BaseProject *bp, std::string file);
 	void cleanup();
 };
 
+// Textures shared by all the assets using the same file: decoded, uploaded and destroyed only once.
+// Used only by the main thread, the decoding runs on the loading pool.
+struct TextureRegistry {
+	struct Entry {
+		Texture texture;
+		std::shared_future<void> loading;
+		bool uploaded = false;
+		uint32_t references = 0;
+	};
+
+	BaseProject *BP;
+	std::map<std::string, Entry> textures;
+
+	void init(BaseProject *bp);
+	// Take a reference to the texture of file, the first one starts its decoding
+	void acquire(std::string file);
+	// Wait for the decoding and upload the texture if needed
+	Texture* finish(std::string file);
+	// Drop a reference, the last one destroys the texture
+	void release(std::string file);
+	// Hot reload: load and upload again the texture of a changed image or container, the swap added
+	// to swaps replaces it when the GPU no longer uses it. False if no asset uses the file
+	bool prepareReload(const std::string& file, std::vector<std::function<void()>>& swaps);
+};
+
 struct DescriptorSetLayoutBinding {
 	uint32_t binding;
 	VkDescriptorType type;
@@ -231,9 +423,20 @@ struct Pipeline {
 	BaseProject *BP;
 	VkPipeline graphicsPipeline;
   	VkPipelineLayout pipelineLayout;
+  	VertexFormat vertexFormat;
+  	// Kept to build the pipeline again when a shader changes, the handles and not the DescriptorSetLayout
+  	// objects, which the caller may have passed as temporaries
+  	std::string vertShaderFile;
+  	std::string fragShaderFile;
+  	std::vector<VkDescriptorSetLayout> layouts;
   	
+  	// VERTEX_COMPACT pipelines read CompactVertex and take the MeshQuantization of the model as push constant
   	void init(BaseProject *bp, const std::string& VertShader, const std::string& FragShader,
-  			  std::vector<DescriptorSetLayout *> D);
+  			  std::vector<DescriptorSetLayout *> D, VertexFormat format = VERTEX_FULL);
+  	void create();
+  	bool usesShader(const std::string& file);
+  	// Hot reload: build the pipeline with the changed shaders, the returned swap replaces the old one
+  	std::function<void()> prepareReload();
   	VkShaderModule createShaderModule(const std::vector<char>& code);
   	static std::vector<char> readFile(const std::string& filename);  	
 	void cleanup();
@@ -259,6 +462,133 @@ struct DescriptorSet {
 
 	void init(BaseProject *bp, DescriptorSetLayout *L,
 		std::vector<DescriptorSetElement> E);
+	// Point the texture binding to another image, only while no command buffer using the set is pending
+	void updateTexture(int binding, Texture *tex);
+	void cleanup();
+};
+
+// Subsystem that owns a device memory allocation
+enum MemoryTag {MEM_OTHER, MEM_VERTEX, MEM_INDEX, MEM_TEXTURE, MEM_UNIFORM, MEM_DEPTH, MEM_STAGING, MEM_OFFSCREEN,
+				MEM_TAG_COUNT};
+
+// Keeps the size and the subsystem of every vkAllocateMemory done through BaseProject,
+// every allocation must be released with BaseProject::freeMemory to be accounted
+struct MemoryRegistry {
+	struct TagStats {
+		VkDeviceSize liveBytes = 0;
+		VkDeviceSize peakBytes = 0;
+		uint32_t allocations = 0;
+	};
+
+	std::mutex registryMutex;
+	std::map<VkDeviceMemory, std::pair<MemoryTag, VkDeviceSize>> allocations;
+	TagStats tags[MEM_TAG_COUNT];
+	TagStats total;
+	uint32_t maxAllocations = 4096;
+	bool warned = false;
+
+	static const char* tagName(MemoryTag tag);
+	void init(uint32_t maxMemoryAllocationCount);
+	void add(VkDeviceMemory memory, MemoryTag tag, VkDeviceSize size);
+	void remove(VkDeviceMemory memory);
+	void dump();
+};
+
+// GPU timestamps written around sections of the command buffers.
+// Every swap chain image owns 2 * maxZones queries, the results are read
+// without waiting once the fence of the frame that used them has been signaled.
+struct GpuTimer {
+	struct ZoneStats {
+		double totalMs = 0;
+		double maxMs = 0;
+		uint64_t count = 0;
+	};
+
+	BaseProject *BP;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	uint32_t maxZones;
+	float timestampPeriod;
+	uint64_t timestampMask;
+	std::vector<std::vector<std::string>> zoneNames;
+	std::vector<bool> submitted;
+	uint64_t collectedFrames = 0;
+
+	std::string outputFile;
+	nlohmann::json frames = nlohmann::json::array();
+	std::map<std::string, ZoneStats> summary;
+
+	void init(BaseProject *bp, uint32_t images, uint32_t zonesPerImage, std::string file);
+	bool isEnabled() { return queryPool != VK_NULL_HANDLE; }
+	void reset(VkCommandBuffer commandBuffer, int currentImage);
+	int beginZone(VkCommandBuffer commandBuffer, int currentImage, const std::string& name);
+	void endZone(VkCommandBuffer commandBuffer, int currentImage, int zone);
+	void markSubmitted(int currentImage);
+	void collect(int currentImage);
+	void writeJSON();
+	void cleanup();
+};
+
+// Staging memory for one upload: a part of the staging ring, or a buffer of its own when it does not fit there
+struct StagingAllocation {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	void* data;
+};
+
+// Records the transfers of a load phase (layout transitions, copies, mip blits) and submits them together with
+// a fence, without waiting. The staging data comes from a ring buffer mapped once at startup: collect() gives
+// back the part of each submission once its fence signals, and keeps the fence for the next submissions.
+// With a transfer only queue family the copies run there, in parallel with the rendering: the images and buffers
+// are then released by the transfer queue and acquired by the graphics queue, which waits for a semaphore.
+// While a batch is open beginSingleTimeCommands returns its graphics command buffer and endSingleTimeCommands does nothing.
+struct UploadBatch {
+	struct Submission {
+		VkCommandBuffer transferCommands;
+		VkCommandBuffer graphicsCommands;
+		VkSemaphore copied;
+		VkFence fence;
+		// Ring offset after the staging data of the submission
+		VkDeviceSize ringEnd;
+		std::vector<std::pair<VkBuffer, VkDeviceMemory>> stagingBuffers;
+	};
+
+	BaseProject *BP;
+	bool open = false;
+	// Being recorded, without a transfer queue both are the same command buffer
+	VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+	VkCommandBuffer graphicsCommands = VK_NULL_HANDLE;
+	// Allocations too large for the ring
+	std::vector<std::pair<VkBuffer, VkDeviceMemory>> stagingBuffers;
+	// Submitted, from the oldest
+	std::vector<Submission> inFlight;
+	uint32_t submissions = 0;
+
+	// Staging ring, in use from ringTail to ringHead wrapping around the end (empty when they are equal)
+	VkDeviceSize ringSize = 64 * 1024 * 1024;
+	VkBuffer ringBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory ringMemory = VK_NULL_HANDLE;
+	uint8_t* ringData = nullptr;
+	VkDeviceSize ringHead = 0;
+	VkDeviceSize ringTail = 0;
+
+	// Of the completed submissions, reused by the next ones
+	std::vector<VkFence> freeFences;
+	std::vector<VkSemaphore> freeSemaphores;
+
+	void init(BaseProject *bp);
+	void begin();
+	bool usesTransferQueue();
+	VkCommandBuffer recordTransfer();
+	VkCommandBuffer recordGraphics();
+	void handOffImage(VkImage image, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout,
+					  VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+	void handOffBuffer(VkBuffer buffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+	bool ringAllocate(VkDeviceSize size, VkDeviceSize& offset);
+	StagingAllocation allocateStaging(VkDeviceSize size);
+	void releaseStaging();
+	void submit();
+	void collect(bool wait);
+	void end();
 	void cleanup();
 };
 
@@ -270,16 +600,87 @@ class BaseProject {
 	friend class Pipeline;
 	friend class DescriptorSetLayout;
 	friend class DescriptorSet;
+	friend struct GpuTimer;
+	friend class UploadBatch;
 public:
 	virtual void setWindowParameters() = 0;
     void run() {
+    	StartupProfiler::GetInstance()->beginStartup();
     	setWindowParameters();
-        initWindow();
+    	if (!headless) {
+        	initWindow();
+        }
         initVulkan();
+        StartupProfiler::GetInstance()->endStartup();
         mainLoop();
         cleanup();
     }
 
+	// Measure the GPU time of the command buffer sections and save it to a JSON file at exit
+	void setGpuTiming(std::string file) {
+		gpuTimingFile = file;
+	}
+
+	// Render offscreen without window, surface and swap chain, stopping after the given number of frames
+	// (0 = until stopRequested is set, i.e. the end of the replay)
+	void setHeadless(uint32_t frames) {
+		headless = true;
+		headlessFrames = frames;
+	}
+
+	// Number of threads parsing the models and decoding the textures during localInit (0 = main thread only)
+	void setLoadingThreads(unsigned int threads) {
+		loadingThreads = threads;
+	}
+
+	ThreadPool* getLoadingPool() {
+		return &loadingPool;
+	}
+
+	TextureRegistry* getTextureRegistry() {
+		return &textureRegistry;
+	}
+
+	// Load the BC textures built by TextureCompiler when the device supports them (default true)
+	void setCompressedTextures(bool enable) {
+		compressedTextures = enable;
+	}
+
+	bool supportsCompressedTextures() {
+		return compressedTextures;
+	}
+
+	// Size of the staging ring that all the uploads go through, allocated at startup (default 64 MB)
+	void setStagingSize(VkDeviceSize bytes) {
+		uploadBatch.ringSize = bytes;
+	}
+
+	// Draw the assets with CompactVertex and the dequantizing material shader (default false)
+	void setCompactVertices(bool enable) {
+		compactVertices = enable;
+	}
+
+	bool usesCompactVertices() {
+		return compactVertices;
+	}
+
+	// Upload on a transfer only queue when the device has one (default true)
+	void setTransferQueue(bool enable) {
+		transferQueueEnabled = enable;
+	}
+
+	// Load again the models, textures and shaders whose files change while the game runs (default false)
+	void setHotReload(bool enable) {
+		hotReload = enable;
+	}
+
+	// Reload the users of file when it changes, with hot reload enabled
+	void watchFile(const std::string& file) {
+		if (hotReload) {
+			fileWatcher.watch(file);
+		}
+	}
+
 protected:
 	uint32_t windowWidth;
 	uint32_t windowHeight;
@@ -290,8 +691,49 @@ protected:
 	int texturesInPool;
 	int setsInPool;
 
+	// Headless mode: frames go to offscreenImages instead of the swap chain
+	bool headless = false;
+	uint32_t headlessFrames = 0;
+	std::vector<VkDeviceMemory> offscreenImagesMemory;
+
+	// Set by the application to leave the main loop at the end of the current frame
+	bool stopRequested = false;
+
+	// GPU timestamp queries, enabled only when gpuTimingFile is set
+	std::string gpuTimingFile;
+	GpuTimer gpuTimer;
+	// Sections recorded in every command buffer at most, set by the application before initVulkan
+	uint32_t gpuTimerZones = 64;
+
+	// Device memory allocated by createBuffer and createImage
+	MemoryRegistry memoryRegistry;
+
+	// Transfers of localInit, submitted together
+	UploadBatch uploadBatch;
+
+	// Asset loading threads, running only during localInit
+	unsigned int loadingThreads = std::thread::hardware_concurrency();
+	ThreadPool loadingPool;
+
+	// Textures shared between the assets
+	TextureRegistry textureRegistry;
+
+	// Requested by the user, then cleared in createLogicalDevice if the device cannot sample BC formats
+	bool compressedTextures = true;
+
+	// Quantized vertices for the assets, requested by the user
+	bool compactVertices = false;
+
+	// Requested by the user, then cleared in createLogicalDevice if there is no transfer only queue family
+	bool transferQueueEnabled = true;
+
+	// Hot reload: the files used by the assets and the pipelines, checked once per frame
+	bool hotReload = false;
+	FileWatcher fileWatcher;
+	std::vector<Pipeline *> pipelines;
+
 	// Lesson 12
-    GLFWwindow* window;
+    GLFWwindow* window = nullptr;
     VkInstance instance;
 
     // Lesson 13
@@ -300,6 +742,11 @@ protected:
     VkDevice device;
     VkQueue graphicsQueue;
     VkQueue presentQueue;
+    uint32_t graphicsQueueFamily;
+    // Only with a transfer only queue family, otherwise the uploads go through graphicsQueue
+    VkQueue transferQueue = VK_NULL_HANDLE;
+    uint32_t transferQueueFamily;
+    VkCommandPool transferCommandPool = VK_NULL_HANDLE;
 	VkCommandPool commandPool;
 	std::vector<VkCommandBuffer> commandBuffers;
 
@@ -355,18 +802,45 @@ protected:
     void initVulkan() {
 		createInstance();				// L12
 		setupDebugMessenger();			// L22.0
-		createSurface();				// L13
+		if (!headless) {
+			createSurface();			// L13
+		}
 		pickPhysicalDevice();			// L14
 		createLogicalDevice();			// L14
-		createSwapChain();				// L15
+		{
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+			memoryRegistry.init(properties.limits.maxMemoryAllocationCount);
+		}
+		if (headless) {
+			createOffscreenImages();
+		} else {
+			createSwapChain();			// L15
+		}
 		createImageViews();				// L15
 		createRenderPass();				// L19
 		createCommandPool();			// L13
+		if (!gpuTimingFile.empty()) {
+			gpuTimer.init(this, swapChainImages.size(), gpuTimerZones, gpuTimingFile);
+		}
 		createDepthResources();			// L22.1
 		createFramebuffers();			// L22.2
 		createDescriptorPool();			// L21
 
-		localInit();
+		textureRegistry.init(this);
+		uploadBatch.init(this);
+		uploadBatch.begin();
+		loadingPool.start(loadingThreads);
+		try {
+			localInit();
+		}
+		catch (...) {
+			// The queued loads use the assets of the derived class, which are destroyed before the pool
+			loadingPool.stop();
+			throw;
+		}
+		loadingPool.stop();
+		uploadBatch.end();
 
 		createCommandBuffers();			// L22.5 (13)
 		createSyncObjects();			// L22.3 
@@ -386,13 +860,6 @@ protected:
 		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 		createInfo.pApplicationInfo = &appInfo;
 
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-				
-		createInfo.enabledExtensionCount = glfwExtensionCount;
-		createInfo.ppEnabledExtensionNames = glfwExtensions;
-
 		createInfo.enabledLayerCount = 0;
 
 		auto extensions = getRequiredExtensions();
@@ -425,14 +892,18 @@ protected:
     
     // Lesson 12 and L22.0
     std::vector<const char*> getRequiredExtensions() {
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions =
-			glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-		std::vector<const char*> extensions(glfwExtensions,
-			glfwExtensions + glfwExtensionCount);
-			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		std::vector<const char*> extensions;
+
+		// Without a window there is no surface, so GLFW extensions are not needed
+		if (!headless) {
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions =
+				glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			extensions.assign(glfwExtensions,
+				glfwExtensions + glfwExtensionCount);
+		}
+		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 		
 		return extensions;
 	}
@@ -541,10 +1012,10 @@ protected:
     bool isDeviceSuitable(VkPhysicalDevice device) {
  		QueueFamilyIndices indices = findQueueFamilies(device);
 
-		bool extensionsSupported = checkDeviceExtensionSupport(device);
+		bool extensionsSupported = headless || checkDeviceExtensionSupport(device);
 
-		bool swapChainAdequate = false;
-		if (extensionsSupported) {
+		bool swapChainAdequate = headless;
+		if (extensionsSupported && !headless) {
 			SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 			swapChainAdequate = !swapChainSupport.formats.empty() &&
 								!swapChainSupport.presentModes.empty();
@@ -568,6 +1039,22 @@ protected:
 		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
 								queueFamilies.data());
+
+		// Prefer a family made only for copies to one that can also compute. A coarser image transfer
+		// granularity would not allow copying the small mip levels
+		for (uint32_t j = 0; j < queueFamilyCount; j++) {
+			VkQueueFlags flags = queueFamilies[j].queueFlags;
+			VkExtent3D granularity = queueFamilies[j].minImageTransferGranularity;
+			if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT) ||
+				granularity.width != 1 || granularity.height != 1 || granularity.depth != 1) {
+				continue;
+			}
+			if (!indices.transferFamily.has_value() ||
+				((queueFamilies[indices.transferFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+				 !(flags & VK_QUEUE_COMPUTE_BIT))) {
+				indices.transferFamily = j;
+			}
+		}
 								
 		int i=0;
 		for (const auto& queueFamily : queueFamilies) {
@@ -575,9 +1062,14 @@ protected:
 				indices.graphicsFamily = i;
 			}
 				
+			// Headless mode never presents: the graphics queue is enough
 			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
-												 &presentSupport);
+			if (headless) {
+				presentSupport = indices.graphicsFamily.has_value();
+			} else {
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
+													 &presentSupport);
+			}
 			if (presentSupport) {
 			 	indices.presentFamily = i;
 			}
@@ -648,6 +1140,10 @@ protected:
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 		std::set<uint32_t> uniqueQueueFamilies =
 				{indices.graphicsFamily.value(), indices.presentFamily.value()};
+		transferQueueEnabled = transferQueueEnabled && indices.transferFamily.has_value();
+		if (transferQueueEnabled) {
+			uniqueQueueFamilies.insert(indices.transferFamily.value());
+		}
 		
 		float queuePriority = 1.0f;
 		for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -659,8 +1155,19 @@ protected:
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 		
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+		compressedTextures = compressedTextures && supportedFeatures.textureCompressionBC;
+		for (VkFormat format : {VK_FORMAT_BC1_RGB_SRGB_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK}) {
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+			compressedTextures = compressedTextures && (formatProperties.optimalTilingFeatures &
+								 VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+		}
+
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.textureCompressionBC = compressedTextures ? VK_TRUE : VK_FALSE;
 		
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -670,7 +1177,7 @@ protected:
 			static_cast<uint32_t>(queueCreateInfos.size());
 		
 		createInfo.pEnabledFeatures = &deviceFeatures;
-		createInfo.enabledExtensionCount =
+		createInfo.enabledExtensionCount = headless ? 0 :
 				static_cast<uint32_t>(deviceExtensions.size());
 		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
@@ -687,6 +1194,11 @@ protected:
 		
 		vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+		graphicsQueueFamily = indices.graphicsFamily.value();
+		if (transferQueueEnabled) {
+			transferQueueFamily = indices.transferFamily.value();
+			vkGetDeviceQueue(device, transferQueueFamily, 0, &transferQueue);
+		}
 	}
 	
 	// Lesson 14
@@ -750,6 +1262,23 @@ protected:
 		swapChainExtent = extent;
 	}
 
+	// Headless mode: one color image per frame in flight takes the place of the swap chain
+	void createOffscreenImages() {
+		swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+		swapChainExtent = { windowWidth, windowHeight };
+
+		swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+		offscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT);
+		for (size_t i = 0; i < swapChainImages.size(); i++) {
+			createImage(swapChainExtent.width, swapChainExtent.height, 1,
+						swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+						VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+						VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						swapChainImages[i], offscreenImagesMemory[i], MEM_OFFSCREEN);
+		}
+	}
+
 	// Lesson 14
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(
 				const std::vector<VkSurfaceFormatKHR>& availableFormats)
@@ -858,7 +1387,9 @@ protected:
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachment.finalLayout = headless ?
+						VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL :
+						VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 		
 		VkAttachmentReference colorAttachmentRef{};
 		colorAttachmentRef.attachment = 0;
@@ -943,6 +1474,16 @@ protected:
 		 	PrintVkError(result);
 			throw std::runtime_error("failed to create command pool!");
 		}
+
+		if (transferQueue != VK_NULL_HANDLE) {
+			poolInfo.queueFamilyIndex = transferQueueFamily;
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			result = vkCreateCommandPool(device, &poolInfo, nullptr, &transferCommandPool);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create transfer command pool!");
+			}
+		}
 	}
 
 	// Lesson 22.1
@@ -953,7 +1494,7 @@ protected:
 					VK_IMAGE_TILING_OPTIMAL,
 					VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
 					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					depthImage, depthImageMemory);
+					depthImage, depthImageMemory, MEM_DEPTH);
 		depthImageView = createImageView(depthImage, depthFormat,
 										 VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 	}
@@ -964,7 +1505,7 @@ protected:
 					 VkFormat format,
 				 	 VkImageTiling tiling, VkImageUsageFlags usage,
 				 	 VkMemoryPropertyFlags properties, VkImage& image,
-				 	 VkDeviceMemory& imageMemory) {		
+				 	 VkDeviceMemory& imageMemory, MemoryTag tag = MEM_OTHER) {		
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -999,6 +1540,7 @@ protected:
 								VK_SUCCESS) {
 			throw std::runtime_error("failed to allocate image memory!");
 		}
+		memoryRegistry.add(imageMemory, tag, allocInfo.allocationSize);
 
 		vkBindImageMemory(device, image, imageMemory, 0);
 	}
@@ -1096,7 +1638,7 @@ protected:
 	void transitionImageLayout(VkImage image, VkFormat format,
 					VkImageLayout oldLayout, VkImageLayout newLayout,
 					uint32_t mipLevels) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		VkCommandBuffer commandBuffer = beginTransferCommands();
 
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1120,16 +1662,16 @@ protected:
 								VK_ACCESS_TRANSFER_WRITE_BIT, 0,
 								0, nullptr, 0, nullptr, 1, &barrier);
 
-		endSingleTimeCommands(commandBuffer);
+		endTransferCommands(commandBuffer);
 	}
 	
 	// New - Lesson 23
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t
-						   width, uint32_t height) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+						   width, uint32_t height, VkDeviceSize bufferOffset = 0) {
+		VkCommandBuffer commandBuffer = beginTransferCommands();
 		
 		VkBufferImageCopy region{};
-		region.bufferOffset = 0;
+		region.bufferOffset = bufferOffset;
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1142,11 +1684,15 @@ protected:
 		vkCmdCopyBufferToImage(commandBuffer, buffer, image,
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-		endSingleTimeCommands(commandBuffer);
+		endTransferCommands(commandBuffer);
 	}
 	
 	// New - Lesson 23
 	VkCommandBuffer beginSingleTimeCommands() { 
+		if (uploadBatch.open) {
+			return uploadBatch.recordGraphics();
+		}
+
 		VkCommandBufferAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -1167,6 +1713,10 @@ protected:
 	
 	// New - Lesson 23
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+		if (uploadBatch.open) {
+			return;
+		}
+
 		vkEndCommandBuffer(commandBuffer);
 		
 		VkSubmitInfo submitInfo{};
@@ -1178,15 +1728,50 @@ protected:
 		
 		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 	}
+
+	// Command buffer for copies and transitions to TRANSFER_DST only: while an upload batch is open it
+	// runs on the transfer queue, and the resources must then be handed off by the batch
+	VkCommandBuffer beginTransferCommands() {
+		if (uploadBatch.open) {
+			return uploadBatch.recordTransfer();
+		}
+		return beginSingleTimeCommands();
+	}
+
+	void endTransferCommands(VkCommandBuffer commandBuffer) {
+		endSingleTimeCommands(commandBuffer);
+	}
 	
 
 
 	// Lesson 22.4
 	
 	// Lesson 21
+	// Device local buffer filled with size bytes of src through a staging buffer, the copy joins the upload
+	// batch when one is open
+	void createDeviceLocalBuffer(const void* src, VkDeviceSize size, VkBufferUsageFlags usage,
+								 VkAccessFlags dstAccess, VkBuffer& buffer, VkDeviceMemory& bufferMemory,
+								 MemoryTag tag) {
+		StagingAllocation staging = uploadBatch.allocateStaging(size);
+		memcpy(staging.data, src, (size_t) size);
+
+		createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					 buffer, bufferMemory, tag);
+
+		VkCommandBuffer commandBuffer = beginTransferCommands();
+		VkBufferCopy region{};
+		region.srcOffset = staging.offset;
+		region.size = size;
+		vkCmdCopyBuffer(commandBuffer, staging.buffer, buffer, 1, &region);
+		endTransferCommands(commandBuffer);
+
+		uploadBatch.handOffBuffer(buffer, dstAccess, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+		uploadBatch.releaseStaging();
+	}
+
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 					  VkMemoryPropertyFlags properties,
-					  VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+					  VkBuffer& buffer, VkDeviceMemory& bufferMemory, MemoryTag tag = MEM_OTHER) {
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size = size;
@@ -1215,10 +1800,17 @@ protected:
 		 	PrintVkError(result);
 			throw std::runtime_error("failed to allocate vertex buffer memory!");
 		}
+		memoryRegistry.add(bufferMemory, tag, allocInfo.allocationSize);
 		
 		vkBindBufferMemory(device, buffer, bufferMemory, 0);	
 	}
 	
+	// Release the memory of createBuffer and createImage
+	void freeMemory(VkDeviceMemory memory) {
+		memoryRegistry.remove(memory);
+		vkFreeMemory(device, memory, nullptr);
+	}
+
 	// Lesson 21
 	uint32_t findMemoryType(uint32_t typeFilter,
 							VkMemoryPropertyFlags properties) {
@@ -1295,6 +1887,9 @@ protected:
 				throw std::runtime_error("failed to begin recording command buffer!");
 			}
 			
+			gpuTimer.reset(commandBuffers[i], i);
+			int frameZone = gpuTimer.beginZone(commandBuffers[i], i, "Frame");
+
 			VkRenderPassBeginInfo renderPassInfo{};
 			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 			renderPassInfo.renderPass = renderPass; 
@@ -1319,6 +1914,8 @@ protected:
 
 			vkCmdEndRenderPass(commandBuffers[i]);
 
+			gpuTimer.endZone(commandBuffers[i], i, frameZone);
+
 			if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
 				throw std::runtime_error("failed to record command buffer!");
 			}
@@ -1359,44 +1956,150 @@ protected:
     
     // Lesson 22.6 --- Main Rendering Loop
     void mainLoop() {
-        while (!glfwWindowShouldClose(window)) {
+    	if (headless) {
+    		headlessLoop();
+    		return;
+    	}
+
+        while (!glfwWindowShouldClose(window) && !stopRequested) {
             glfwPollEvents();
+            if (hotReload) {
+            	reloadChangedFiles();
+            }
             drawFrame();
         }
         
         vkDeviceWaitIdle(device);
     }
     
+    // Hot reload hook of the application: prepare what it loaded from file again, while the GPU may still
+    // use the old version, and add to swaps what replaces it. False if the application does not use file
+    virtual bool localPrepareReload(const std::string& file, std::vector<std::function<void()>>& swaps) {
+    	return false;
+    }
+
+    // Called between two frames: the changed files are loaded and uploaded while the frames in flight are
+    // drawn, then the old resources are replaced and the command buffers, which refer to them, recorded again
+    void reloadChangedFiles() {
+    	std::vector<std::string> files = fileWatcher.poll();
+    	if (files.empty()) {
+    		return;
+    	}
+    	TRACE_ZONE("Hot reload");
+    	auto startTime = std::chrono::high_resolution_clock::now();
+
+    	std::vector<std::function<void()>> swaps;
+    	uploadBatch.begin();
+    	for (const std::string& file : files) {
+    		try {
+    			bool used = false;
+    			for (Pipeline* pipeline : pipelines) {
+    				if (pipeline->usesShader(file)) {
+    					swaps.push_back(pipeline->prepareReload());
+    					used = true;
+    				}
+    			}
+    			used = textureRegistry.prepareReload(file, swaps) || used;
+    			used = localPrepareReload(file, swaps) || used;
+    			if (used) {
+    				std::cout << "Reloading " << file << "\n";
+    			}
+    		}
+    		catch (const std::exception& e) {
+    			// The old version stays in use until the file is fixed
+    			std::cout << "failed to reload " << file << ": " << e.what() << "\n";
+    		}
+    	}
+    	uploadBatch.end();
+    	if (swaps.empty()) {
+    		return;
+    	}
+
+    	// The frames in flight are the only users of the old resources and of the command buffers
+    	vkWaitForFences(device, static_cast<uint32_t>(inFlightFences.size()), inFlightFences.data(),
+    					VK_TRUE, UINT64_MAX);
+    	for (auto const& swap : swaps) {
+    		swap();
+    	}
+    	vkFreeCommandBuffers(device, commandPool,
+    			static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    	createCommandBuffers();
+
+    	float elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>
+    			(std::chrono::high_resolution_clock::now() - startTime).count();
+    	std::cout << "Hot reload: " << files.size() << " files in " << elapsed << " ms\n";
+    }
+
+    // Headless mode: draw a fixed number of frames as fast as possible and report the throughput
+    void headlessLoop() {
+    	auto startTime = std::chrono::high_resolution_clock::now();
+
+    	uint32_t frames = 0;
+    	while ((headlessFrames == 0 || frames < headlessFrames) && !stopRequested) {
+    		drawFrame();
+    		frames++;
+    	}
+    	vkDeviceWaitIdle(device);
+
+    	float elapsed = std::chrono::duration<float, std::chrono::seconds::period>
+    			(std::chrono::high_resolution_clock::now() - startTime).count();
+    	std::cout << "Headless run: " << frames << " frames in " << elapsed << " s";
+    	if (frames > 0) {
+    		std::cout << " (" << 1000.0f * elapsed / frames << " ms/frame, "
+    				  << frames / elapsed << " fps)";
+    	}
+    	std::cout << "\n";
+    }
+
     // Lesson 22.6
     void drawFrame() {
-		vkWaitForFences(device, 1, &inFlightFences[currentFrame],
-						VK_TRUE, UINT64_MAX);
+		TRACE_ZONE("drawFrame");
+		{
+			TRACE_ZONE("vkWaitForFences");
+			vkWaitForFences(device, 1, &inFlightFences[currentFrame],
+							VK_TRUE, UINT64_MAX);
+		}
+		// Staging buffers of the uploads completed meanwhile
+		uploadBatch.collect(false);
 		
 		uint32_t imageIndex;
 		
-		VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
-				imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		VkResult result = VK_SUCCESS;
+		if (headless) {
+			imageIndex = currentFrame % swapChainImages.size();
+		} else {
+			TRACE_ZONE("vkAcquireNextImageKHR");
+			result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
+					imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		}
 
 		if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+			TRACE_ZONE("vkWaitForFences (image)");
 			vkWaitForFences(device, 1, &imagesInFlight[imageIndex],
 							VK_TRUE, UINT64_MAX);
 		}
 		imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+
+		// The previous use of this image has completed, its timestamps are ready
+		gpuTimer.collect(imageIndex);
 		
-		updateUniformBuffer(imageIndex);
+		{
+			TRACE_ZONE("updateUniformBuffer");
+			updateUniformBuffer(imageIndex);
+		}
 		
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
 		VkPipelineStageFlags waitStages[] =
 			{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.waitSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
 		VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.signalSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 		
 		vkResetFences(device, 1, &inFlightFences[currentFrame]);
@@ -1405,7 +2108,13 @@ protected:
 				inFlightFences[currentFrame]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to submit draw command buffer!");
 		}
+		gpuTimer.markSubmitted(imageIndex);
 		
+		if (headless) {
+			currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+			return;
+		}
+
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 		presentInfo.waitSemaphoreCount = 1;
@@ -1417,7 +2126,10 @@ protected:
 		presentInfo.pImageIndices = &imageIndex;
 		presentInfo.pResults = nullptr; // Optional
 		
-		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		{
+			TRACE_ZONE("vkQueuePresentKHR");
+			result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		}
 
 		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     }
@@ -1429,9 +2141,11 @@ protected:
 	// All lessons
 	
     void cleanup() {
+		memoryRegistry.dump();
+
 		vkDestroyImageView(device, depthImageView, nullptr);
 		vkDestroyImage(device, depthImage, nullptr);
-		vkFreeMemory(device, depthImageMemory, nullptr);
+		freeMemory(depthImageMemory);
 
 		for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 			vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
@@ -1442,11 +2156,21 @@ protected:
 
 		vkDestroyRenderPass(device, renderPass, nullptr);
 
+		gpuTimer.cleanup();
+		uploadBatch.cleanup();
+
 		for (size_t i = 0; i < swapChainImageViews.size(); i++){
 			vkDestroyImageView(device, swapChainImageViews[i], nullptr);
 		}
 		
-		vkDestroySwapchainKHR(device, swapChain, nullptr);
+		if (headless) {
+			for (size_t i = 0; i < swapChainImages.size(); i++) {
+				vkDestroyImage(device, swapChainImages[i], nullptr);
+				freeMemory(offscreenImagesMemory[i]);
+			}
+		} else {
+			vkDestroySwapchainKHR(device, swapChain, nullptr);
+		}
 		
 		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
     	
@@ -1460,17 +2184,31 @@ protected:
     	}
     	
     	vkDestroyCommandPool(device, commandPool, nullptr);
+    	if (transferCommandPool != VK_NULL_HANDLE) {
+    		vkDestroyCommandPool(device, transferCommandPool, nullptr);
+    	}
     	
+    	if (!memoryRegistry.allocations.empty()) {
+    		std::cout << "Warning: " << memoryRegistry.allocations.size()
+    				  << " device memory allocations were not freed\n";
+    	}
  		vkDestroyDevice(device, nullptr);
 		
 		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 		
-		vkDestroySurfaceKHR(instance, surface, nullptr);
+		if (!headless) {
+			vkDestroySurfaceKHR(instance, surface, nullptr);
+		}
     	vkDestroyInstance(instance, nullptr);
 
-        glfwDestroyWindow(window);
+		if (!headless) {
+        	glfwDestroyWindow(window);
 
-        glfwTerminate();
+        	glfwTerminate();
+        }
+
+		StartupProfiler::GetInstance()->report();
+		Tracer::GetInstance()->save();
     }
 	
 };
@@ -1484,11 +2222,15 @@ void Model::loadModel(std::string file) {
 	std::vector<tinyobj::material_t> materials;
 	std::string warn, err;
 	
+	StartupZone zone(file, "OBJ parse");
 	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
 						  file.c_str())) {
 		throw std::runtime_error(warn + err);
 	}
 	
+	// Every corner of the OBJ faces is a vertex, the identical ones are stored once
+	std::unordered_map<Vertex, uint32_t> uniqueVertices;
+	
 	for (const auto& shape : shapes) {
 		for (const auto& index : shape.mesh.indices) {
 			Vertex vertex{};
@@ -1510,10 +2252,222 @@ void Model::loadModel(std::string file) {
 				attrib.normals[3 * index.normal_index + 2]
 			};
 			
-			vertices.push_back(vertex);
-			indices.push_back(vertices.size()-1);
+			if (uniqueVertices.count(vertex) == 0) {
+				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(vertex);
+			}
+			indices.push_back(uniqueVertices[vertex]);
+		}
+	}
+
+	if (!vertices.empty()) {
+		aabbMin = aabbMax = vertices[0].pos;
+	}
+	for (const Vertex& vertex : vertices) {
+		aabbMin = glm::min(aabbMin, vertex.pos);
+		aabbMax = glm::max(aabbMax, vertex.pos);
+	}
+}
+
+// The images are kept encoded and decoded later by Texture, on the loading threads
+static bool keepEncodedImage(tinygltf::Image* image, const int index, std::string* err, std::string* warn,
+							 int width, int height, const unsigned char* bytes, int size, void* userData) {
+	image->image.assign(bytes, bytes + size);
+	image->as_is = true;
+	return true;
+}
+
+// Local transform of a glTF node, either its matrix or its translation, rotation and scale
+static glm::mat4 gltfNodeTransform(const tinygltf::Node& node) {
+	if (node.matrix.size() == 16) {
+		glm::mat4 matrix;
+		for (int i = 0; i < 16; i++) {
+			matrix[i / 4][i % 4] = (float)node.matrix[i];
+		}
+		return matrix;
+	}
+	glm::mat4 matrix(1.0f);
+	if (node.translation.size() == 3) {
+		matrix = glm::translate(matrix, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+	}
+	if (node.rotation.size() == 4) {
+		matrix = matrix * glm::mat4_cast(glm::quat((float)node.rotation[3], (float)node.rotation[0],
+												   (float)node.rotation[1], (float)node.rotation[2]));
+	}
+	if (node.scale.size() == 3) {
+		matrix = glm::scale(matrix, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+	}
+	return matrix;
+}
+
+// Every triangle primitive reachable from the node, with the transform of its node in the scene
+static void gltfCollectPrimitives(const tinygltf::Model& gltf, int nodeIndex, glm::mat4 parent,
+								  std::vector<std::pair<const tinygltf::Primitive*, glm::mat4>>& primitives) {
+	const tinygltf::Node& node = gltf.nodes.at(nodeIndex);
+	glm::mat4 transform = parent * gltfNodeTransform(node);
+	if (node.mesh >= 0) {
+		for (const tinygltf::Primitive& primitive : gltf.meshes.at(node.mesh).primitives) {
+			if (primitive.mode == TINYGLTF_MODE_TRIANGLES || primitive.mode == -1) {
+				primitives.push_back({ &primitive, transform });
+			}
+		}
+	}
+	for (int child : node.children) {
+		gltfCollectPrimitives(gltf, child, transform, primitives);
+	}
+}
+
+// First byte and stride of the elements of an accessor
+static const unsigned char* gltfAccessorData(const tinygltf::Model& gltf, const tinygltf::Accessor& accessor, size_t& stride) {
+	const tinygltf::BufferView& view = gltf.bufferViews.at(accessor.bufferView);
+	int byteStride = accessor.ByteStride(view);
+	if (accessor.sparse.isSparse || byteStride <= 0 ||
+		view.byteOffset + accessor.byteOffset + (accessor.count - 1) * byteStride +
+		tinygltf::GetComponentSizeInBytes(accessor.componentType) * tinygltf::GetNumComponentsInType(accessor.type) >
+		gltf.buffers.at(view.buffer).data.size()) {
+		throw std::runtime_error("unsupported glTF accessor!");
+	}
+	stride = byteStride;
+	return gltf.buffers.at(view.buffer).data.data() + view.byteOffset + accessor.byteOffset;
+}
+
+void Model::loadGLTF(std::string file) {
+	StartupZone zone(file, "glTF parse");
+	std::shared_ptr<tinygltf::Model> gltf = std::make_shared<tinygltf::Model>();
+	tinygltf::TinyGLTF loader;
+	loader.SetImageLoader(keepEncodedImage, nullptr);
+	std::string warn, err;
+	if (!loader.LoadBinaryFromFile(gltf.get(), &err, &warn, file)) {
+		throw std::runtime_error(warn + err);
+	}
+
+	// All the meshes of the scene in a single model, placed with the transforms of their nodes
+	std::vector<std::pair<const tinygltf::Primitive*, glm::mat4>> primitives;
+	if (!gltf->scenes.empty()) {
+		const tinygltf::Scene& scene = gltf->scenes.at(std::max(gltf->defaultScene, 0));
+		for (int node : scene.nodes) {
+			gltfCollectPrimitives(*gltf, node, glm::mat4(1.0f), primitives);
+		}
+	} else {
+		for (const tinygltf::Mesh& mesh : gltf->meshes) {
+			for (const tinygltf::Primitive& primitive : mesh.primitives) {
+				primitives.push_back({ &primitive, glm::mat4(1.0f) });
+			}
+		}
+	}
+	if (primitives.empty()) {
+		throw std::runtime_error("no triangles in " + file + "!");
+	}
+
+	// A model is drawn with one texture: the merged primitives must share their base color image
+	auto baseColorImage = [&](const tinygltf::Primitive& primitive) {
+		if (primitive.material < 0) {
+			return -1;
+		}
+		int texture = gltf->materials.at(primitive.material).pbrMetallicRoughness.baseColorTexture.index;
+		return texture >= 0 ? gltf->textures.at(texture).source : -1;
+	};
+	int image = baseColorImage(*primitives[0].first);
+	for (auto const& entry : primitives) {
+		if (baseColorImage(*entry.first) != image) {
+			throw std::runtime_error(file + " uses more than one texture, export one model per material!");
+		}
+	}
+
+	for (auto const& entry : primitives) {
+		const tinygltf::Primitive& primitive = *entry.first;
+		const glm::mat4& transform = entry.second;
+		if (primitive.attributes.count("POSITION") == 0) {
+			throw std::runtime_error("glTF primitive without positions in " + file + "!");
+		}
+		const tinygltf::Accessor& position = gltf->accessors.at(primitive.attributes.at("POSITION"));
+		const tinygltf::Accessor* normal = primitive.attributes.count("NORMAL") ?
+			&gltf->accessors.at(primitive.attributes.at("NORMAL")) : nullptr;
+		const tinygltf::Accessor* texCoord = primitive.attributes.count("TEXCOORD_0") ?
+			&gltf->accessors.at(primitive.attributes.at("TEXCOORD_0")) : nullptr;
+		if (position.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT ||
+			(normal && normal->componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) ||
+			(texCoord && texCoord->componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)) {
+			throw std::runtime_error("only float glTF attributes are supported in " + file + "!");
+		}
+		size_t positionStride, normalStride = 0, texCoordStride = 0;
+		const unsigned char* positionData = gltfAccessorData(*gltf, position, positionStride);
+		const unsigned char* normalData = normal ? gltfAccessorData(*gltf, *normal, normalStride) : nullptr;
+		const unsigned char* texCoordData = texCoord ? gltfAccessorData(*gltf, *texCoord, texCoordStride) : nullptr;
+
+		// A single untransformed primitive already interleaved like Vertex goes to the vertex buffer as it is.
+		// This is the exception: the exporters usually write every attribute in its own buffer view, and those
+		// primitives are repacked below
+		if (primitives.size() == 1 && transform == glm::mat4(1.0f) && normal && texCoord &&
+			positionStride == sizeof(Vertex) && normalStride == sizeof(Vertex) && texCoordStride == sizeof(Vertex) &&
+			normalData == positionData + offsetof(Vertex, norm) && texCoordData == positionData + offsetof(Vertex, texCoord) &&
+			position.minValues.size() == 3 && position.maxValues.size() == 3) {
+			vertexSource = positionData;
+			vertexCount = position.count;
+			aabbMin = glm::vec3(position.minValues[0], position.minValues[1], position.minValues[2]);
+			aabbMax = glm::vec3(position.maxValues[0], position.maxValues[1], position.maxValues[2]);
+		} else {
+			glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3(transform)));
+			size_t first = vertices.size();
+			vertices.resize(first + position.count);
+			for (size_t i = 0; i < position.count; i++) {
+				Vertex& vertex = vertices[first + i];
+				vertex.pos = glm::vec3(transform * glm::vec4(*(const glm::vec3*)(positionData + i * positionStride), 1.0f));
+				vertex.norm = normal ? glm::normalize(normalTransform * *(const glm::vec3*)(normalData + i * normalStride)) : glm::vec3(0.0f);
+				vertex.texCoord = texCoord ? *(const glm::vec2*)(texCoordData + i * texCoordStride) : glm::vec2(0.0f);
+			}
+		}
+
+		// 16 and 32 bit indices are used in place, 8 bit ones are widened
+		uint32_t baseVertex = vertexSource != nullptr ? 0 : (uint32_t)(vertices.size() - position.count);
+		if (primitive.indices < 0) {
+			for (uint32_t i = 0; i < position.count; i++) {
+				indices.push_back(baseVertex + i);
+			}
+			continue;
+		}
+		const tinygltf::Accessor& index = gltf->accessors.at(primitive.indices);
+		size_t indexStride;
+		const unsigned char* indexData = gltfAccessorData(*gltf, index, indexStride);
+		if (vertexSource != nullptr && index.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT && indexStride == 4) {
+			indexSource = indexData;
+			indexCount = index.count;
+			continue;
+		}
+		if (vertexSource != nullptr && index.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT && indexStride == 2) {
+			indexSource = indexData;
+			indexCount = index.count;
+			indexType = VK_INDEX_TYPE_UINT16;
+			continue;
+		}
+		for (size_t i = 0; i < index.count; i++) {
+			const unsigned char* value = indexData + i * indexStride;
+			switch (index.componentType) {
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: indices.push_back(baseVertex + *value); break;
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: indices.push_back(baseVertex + *(const uint16_t*)value); break;
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: indices.push_back(baseVertex + *(const uint32_t*)value); break;
+				default: throw std::runtime_error("invalid glTF index type in " + file + "!");
+			}
+		}
+	}
+
+	if (vertexSource == nullptr) {
+		vertexCount = vertices.size();
+		aabbMin = aabbMax = vertices[0].pos;
+		for (const Vertex& vertex : vertices) {
+			aabbMin = glm::min(aabbMin, vertex.pos);
+			aabbMax = glm::max(aabbMax, vertex.pos);
 		}
 	}
+	if (indexSource == nullptr) {
+		indexCount = indices.size();
+	}
+	sourceData = gltf;
+
+	// The base color texture shared by the primitives
+	if (image >= 0) {
+		embeddedTexture = gltf->images.at(image).image;
+	}
 }
 
 void Model::loadText(std::vector<std::string> SceneText) {
@@ -1698,38 +2652,159 @@ void Model::loadText(std::vector<std::string> SceneText) {
 
 // Lesson 21
 void Model::createVertexBuffer() {
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-	
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
-						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-						vertexBuffer, vertexBufferMemory);
+	vertexCount = static_cast<uint32_t>(vertices.size());
+	createVertexBuffer(vertices.data());
+}
 
-	void* data;
-	vkMapMemory(BP->device, vertexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t) bufferSize);
-	vkUnmapMemory(BP->device, vertexBufferMemory);			
+void Model::createVertexBuffer(const void* src) {
+	VkDeviceSize bufferSize = (VkDeviceSize)vertexStride * vertexCount;
+	
+	BP->createDeviceLocalBuffer(src, bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+								VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+								vertexBuffer, vertexBufferMemory, MEM_VERTEX);
 }
 
 void Model::createIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+	indexCount = static_cast<uint32_t>(indices.size());
+	createIndexBuffer(indices.data());
+}
 
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-							 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-							 indexBuffer, indexBufferMemory);
+void Model::createIndexBuffer(const void* src) {
+	VkDeviceSize bufferSize = (VkDeviceSize)indexSize() * indexCount;
 
-	void* data;
-	vkMapMemory(BP->device, indexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t) bufferSize);
-	vkUnmapMemory(BP->device, indexBufferMemory);
+	BP->createDeviceLocalBuffer(src, bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+								VK_ACCESS_INDEX_READ_BIT,
+								indexBuffer, indexBufferMemory, MEM_INDEX);
 }
 
-void Model::init(BaseProject *bp, std::string file) {
-	BP = bp;
+void Model::load(std::string file) {
+	sourceFile = file;
+
+	// Binary glTF is already in a GPU friendly layout, it does not need the mesh cache
+	std::string extension = std::filesystem::path(file).extension().string();
+	if (extension == ".glb" || extension == ".GLB") {
+		loadGLTF(file);
+		narrowIndices();
+		return;
+	}
+
+	// Warm start: the arrays will be copied from the mapped cache file straight into the buffers
+	std::shared_ptr<MappedFile> cacheFile = std::make_shared<MappedFile>();
+	const MeshCacheHeader* cacheHeader;
+	if (MeshCache::GetInstance()->load(file, sizeof(Vertex), *cacheFile, cacheHeader)) {
+		vertexCount = cacheHeader->vertexCount;
+		indexCount = cacheHeader->indexCount;
+		aabbMin = glm::vec3(cacheHeader->aabbMin[0], cacheHeader->aabbMin[1], cacheHeader->aabbMin[2]);
+		aabbMax = glm::vec3(cacheHeader->aabbMax[0], cacheHeader->aabbMax[1], cacheHeader->aabbMax[2]);
+		vertexSource = cacheFile->data() + cacheHeader->vertexOffset;
+		indexSource = cacheFile->data() + cacheHeader->indexOffset;
+		indexType = cacheHeader->indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+		sourceData = cacheFile;
+		uploadPhase = "Mesh cache";
+		return;
+	}
+
 	loadModel(file);
-	createVertexBuffer();
-	createIndexBuffer();
+	if (MeshCache::GetInstance()->isOptimizing()) {
+		optimize();
+	}
+	narrowIndices();
+	MeshCache::GetInstance()->save(file, vertices.data(), vertices.size(), sizeof(Vertex),
+								   indexSource != nullptr ? indexSource : indices.data(), indexCount, indexSize(),
+								   &aabbMin.x, &aabbMax.x);
+}
+
+// Convert the indices to 16 bits when the model has at most 65536 vertices, on the loading thread
+void Model::narrowIndices() {
+	if (indexSource == nullptr) {
+		indexCount = static_cast<uint32_t>(indices.size());
+	}
+	uint32_t count = vertexSource != nullptr ? vertexCount : static_cast<uint32_t>(vertices.size());
+	if (indexType == VK_INDEX_TYPE_UINT16 || count > 65536) {
+		return;
+	}
+
+	const uint32_t* source = indexSource != nullptr ? (const uint32_t*)indexSource : indices.data();
+	shortIndices.resize(indexCount);
+	for (uint32_t i = 0; i < indexCount; i++) {
+		shortIndices[i] = static_cast<uint16_t>(source[i]);
+	}
+	indices.clear();
+	indices.shrink_to_fit();
+	indexSource = shortIndices.data();
+	indexType = VK_INDEX_TYPE_UINT16;
+}
+
+uint32_t Model::indexSize() {
+	return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Done once, before the arrays are saved in the mesh cache
+void Model::optimize() {
+	if (indices.empty()) {
+		return;
+	}
+	StartupZone zone(sourceFile, "Mesh optimization");
+	std::vector<uint32_t> clusters;
+	indices = optimizeVertexCache(indices, vertices.size(), clusters);
+	optimizeOverdraw(indices, clusters, &vertices[0].pos.x, sizeof(Vertex), vertices.size());
+	optimizeVertexFetch(vertices, indices);
+}
+
+// Replace the vertices with CompactVertex, after load() and on the same thread
+void Model::quantize() {
+	StartupZone zone(sourceFile, "Vertex quantization");
+	const Vertex* source = vertices.data();
+	if (vertexSource != nullptr) {
+		source = (const Vertex*)vertexSource;
+	} else {
+		vertexCount = static_cast<uint32_t>(vertices.size());
+	}
+
+	MeshQuantization quantization = getQuantization();
+	compactVertices.resize(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		compactVertices[i] = CompactVertex::encode(source[i], quantization.offset, quantization.scale);
+	}
+	vertices.clear();
+	vertices.shrink_to_fit();
+	vertexSource = compactVertices.data();
+	vertexStride = sizeof(CompactVertex);
+	quantized = true;
+}
+
+MeshQuantization Model::getQuantization() {
+	MeshQuantization quantization;
+	quantization.offset = glm::vec4(aabbMin, 0.0f);
+	quantization.scale = glm::vec4(aabbMax - aabbMin, 0.0f);
+	return quantization;
+}
+
+void Model::upload(BaseProject *bp) {
+	BP = bp;
+
+	StartupZone zone(sourceFile, uploadPhase);
+	if (vertexSource != nullptr) {
+		createVertexBuffer(vertexSource);
+	} else {
+		createVertexBuffer();
+	}
+	if (indexSource != nullptr) {
+		createIndexBuffer(indexSource);
+	} else {
+		createIndexBuffer();
+	}
+	vertexSource = indexSource = nullptr;
+	sourceData.reset();
+	compactVertices.clear();
+	compactVertices.shrink_to_fit();
+	shortIndices.clear();
+	shortIndices.shrink_to_fit();
+}
+
+void Model::init(BaseProject *bp, std::string file) {
+	load(file);
+	upload(bp);
 }
 
 void Model::initText(BaseProject* bp, std::vector<std::string> SceneText) {
@@ -1741,9 +2816,9 @@ void Model::initText(BaseProject* bp, std::vector<std::string> SceneText) {
 
 void Model::cleanup() {
    	vkDestroyBuffer(BP->device, indexBuffer, nullptr);
-   	vkFreeMemory(BP->device, indexBufferMemory, nullptr);
+   	BP->freeMemory(indexBufferMemory);
 	vkDestroyBuffer(BP->device, vertexBuffer, nullptr);
-   	vkFreeMemory(BP->device, vertexBufferMemory, nullptr);
+   	BP->freeMemory(vertexBufferMemory);
 }
 
 
@@ -1752,53 +2827,86 @@ void Model::cleanup() {
 
 
 
-void Texture::createTextureImage(std::string file) {
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(file.c_str(), &texWidth, &texHeight,
-						&texChannels, STBI_rgb_alpha);
-	if (!pixels) {
-		throw std::runtime_error("failed to load texture image!");
-	}
-
+void Texture::createTextureImage() {
 	VkDeviceSize imageSize = texWidth * texHeight * 4;
 	mipLevels = static_cast<uint32_t>(std::floor(
 					std::log2(std::max(texWidth, texHeight)))) + 1;
 	
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	 
-	BP->createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	  						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-	  						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-	  						stagingBuffer, stagingBufferMemory);
-	void* data;
-	vkMapMemory(BP->device, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(BP->device, stagingBufferMemory);
+	StartupZone uploadZone(sourceFile, "Texture upload");
+	StagingAllocation staging = BP->uploadBatch.allocateStaging(imageSize);
+	memcpy(staging.data, pixels, static_cast<size_t>(imageSize));
 	
 	stbi_image_free(pixels);
+	pixels = nullptr;
 	
-	BP->createImage(texWidth, texHeight, mipLevels, VK_FORMAT_R8G8B8A8_SRGB,
+	BP->createImage(texWidth, texHeight, mipLevels, format,
 				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
 				VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage,
-				textureImageMemory);
+				textureImageMemory, MEM_TEXTURE);
 				
-	BP->transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB,
+	BP->transitionImageLayout(textureImage, format,
 			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-	BP->copyBufferToImage(stagingBuffer, textureImage,
-			static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-
-	BP->generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB,
+	BP->copyBufferToImage(staging.buffer, textureImage,
+			static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), staging.offset);
+	// The blits need the graphics queue
+	BP->uploadBatch.handOffImage(textureImage, mipLevels,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	uploadZone.stop();
+
+	StartupZone mipZone(sourceFile, "Mip generation");
+	BP->generateMipmaps(textureImage, format,
 					texWidth, texHeight, mipLevels);
+	mipZone.stop();
 
-	vkDestroyBuffer(BP->device, stagingBuffer, nullptr);
-	vkFreeMemory(BP->device, stagingBufferMemory, nullptr);
+	BP->uploadBatch.releaseStaging();
+}
+
+// Every level comes from the container, so there are no blits and the image needs no TRANSFER_SRC usage
+void Texture::createCompressedTextureImage() {
+	StartupZone uploadZone(sourceFile, "Texture upload");
+	VkDeviceSize dataSize = container->size();
+
+	StagingAllocation staging = BP->uploadBatch.allocateStaging(dataSize);
+	memcpy(staging.data, container->data(), static_cast<size_t>(dataSize));
+
+	BP->createImage(texWidth, texHeight, mipLevels, format,
+				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+				VK_IMAGE_USAGE_SAMPLED_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage,
+				textureImageMemory, MEM_TEXTURE);
+	BP->transitionImageLayout(textureImage, format,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+
+	VkCommandBuffer commandBuffer = BP->beginTransferCommands();
+	std::vector<VkBufferImageCopy> regions(mipLevels);
+	for (uint32_t i = 0; i < mipLevels; i++) {
+		regions[i] = {};
+		regions[i].bufferOffset = staging.offset + containerHeader->levels[i].offset;
+		regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].imageSubresource.mipLevel = i;
+		regions[i].imageSubresource.baseArrayLayer = 0;
+		regions[i].imageSubresource.layerCount = 1;
+		regions[i].imageOffset = {0, 0, 0};
+		regions[i].imageExtent = {containerHeader->levels[i].width, containerHeader->levels[i].height, 1};
+	}
+	vkCmdCopyBufferToImage(commandBuffer, staging.buffer, textureImage,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions.data());
+
+	BP->endTransferCommands(commandBuffer);
+	BP->uploadBatch.handOffImage(textureImage, mipLevels,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+	BP->uploadBatch.releaseStaging();
+	container.reset();
+	containerHeader = nullptr;
 }
 
 void Texture::createTextureImageView() {
 	textureImageView = BP->createImageView(textureImage,
-									   VK_FORMAT_R8G8B8A8_SRGB,
+									   format,
 									   VK_IMAGE_ASPECT_COLOR_BIT,
 									   mipLevels);
 }
@@ -1832,18 +2940,136 @@ void Texture::createTextureSampler() {
 	
 
 
-void Texture::init(BaseProject *bp, std::string file) {
+void Texture::load(std::string file, bool compressed) {
+	sourceFile = file;
+
+	if (compressed) {
+		StartupZone containerZone(file, "Texture container");
+		container = std::make_shared<MappedFile>();
+		if (loadTextureContainer(file, *container, containerHeader)) {
+			texWidth = containerHeader->levels[0].width;
+			texHeight = containerHeader->levels[0].height;
+			mipLevels = containerHeader->mipLevels;
+			format = containerHeader->format == TEXTURE_FORMAT_BC1 ?
+						VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC7_SRGB_BLOCK;
+			return;
+		}
+		container.reset();
+		containerHeader = nullptr;
+	}
+
+	format = VK_FORMAT_R8G8B8A8_SRGB;
+	int texChannels;
+	StartupZone decodeZone(file, "PNG decode");
+	pixels = stbi_load(file.c_str(), &texWidth, &texHeight,
+						&texChannels, STBI_rgb_alpha);
+	if (!pixels) {
+		throw std::runtime_error("failed to load texture image!");
+	}
+}
+
+void Texture::loadFromMemory(std::string name, const std::vector<unsigned char>& encoded) {
+	sourceFile = name;
+	format = VK_FORMAT_R8G8B8A8_SRGB;
+	int texChannels;
+	StartupZone decodeZone(name, "PNG decode");
+	pixels = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()),
+						&texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	if (!pixels) {
+		throw std::runtime_error("failed to load texture image!");
+	}
+}
+
+void Texture::upload(BaseProject *bp) {
 	BP = bp;
-	createTextureImage(file);
+	if (container) {
+		createCompressedTextureImage();
+	} else {
+		createTextureImage();
+	}
 	createTextureImageView();
 	createTextureSampler();
 }
 
+void Texture::init(BaseProject *bp, std::string file) {
+	load(file, bp->supportsCompressedTextures());
+	upload(bp);
+}
+
 void Texture::cleanup() {
    	vkDestroySampler(BP->device, textureSampler, nullptr);
    	vkDestroyImageView(BP->device, textureImageView, nullptr);
 	vkDestroyImage(BP->device, textureImage, nullptr);
-	vkFreeMemory(BP->device, textureImageMemory, nullptr);
+	BP->freeMemory(textureImageMemory);
+}
+
+void TextureRegistry::init(BaseProject *bp) {
+	BP = bp;
+}
+
+void TextureRegistry::acquire(std::string file) {
+	Entry& entry = textures[file];
+	entry.references++;
+	if (entry.references == 1) {
+		Texture* texture = &entry.texture;
+		bool compressed = BP->supportsCompressedTextures();
+		BP->watchFile(file);
+		if (compressed) {
+			BP->watchFile(file + TEXTURE_CONTAINER_EXTENSION);
+		}
+		entry.loading = BP->getLoadingPool()->submit([texture, file, compressed]() { texture->load(file, compressed); }).share();
+	}
+}
+
+Texture* TextureRegistry::finish(std::string file) {
+	Entry& entry = textures.at(file);
+	if (!entry.uploaded) {
+		entry.loading.get();
+		entry.texture.upload(BP);
+		entry.uploaded = true;
+	}
+	return &entry.texture;
+}
+
+void TextureRegistry::release(std::string file) {
+	auto found = textures.find(file);
+	if (found == textures.end() || --found->second.references > 0) {
+		return;
+	}
+	Entry& entry = found->second;
+	entry.loading.wait();
+	if (entry.uploaded) {
+		entry.texture.cleanup();
+	} else if (entry.texture.pixels != nullptr) {
+		stbi_image_free(entry.texture.pixels);
+	}
+	textures.erase(found);
+}
+
+bool TextureRegistry::prepareReload(const std::string& file, std::vector<std::function<void()>>& swaps) {
+	// A rebuilt container is used as it is, a changed image makes its container out of date until
+	// TextureCompiler runs again, so it is decoded
+	std::string source = file;
+	bool compressed = false;
+	size_t extension = file.size() - std::min(file.size(), TEXTURE_CONTAINER_EXTENSION.size());
+	if (file.compare(extension, std::string::npos, TEXTURE_CONTAINER_EXTENSION) == 0) {
+		source = file.substr(0, extension);
+		compressed = BP->supportsCompressedTextures();
+	}
+	auto found = textures.find(source);
+	if (found == textures.end() || !found->second.uploaded) {
+		return false;
+	}
+
+	std::shared_ptr<Texture> fresh = std::make_shared<Texture>();
+	fresh->load(source, compressed);
+	fresh->upload(BP);
+	Texture* texture = &found->second.texture;
+	swaps.push_back([texture, fresh]() {
+		texture->cleanup();
+		*texture = *fresh;
+	});
+	return true;
 }
 
 
@@ -1851,11 +3077,28 @@ void Texture::cleanup() {
 
 
 void Pipeline::init(BaseProject *bp, const std::string& VertShader, const std::string& FragShader,
-					std::vector<DescriptorSetLayout *> D) {
+					std::vector<DescriptorSetLayout *> D, VertexFormat format) {
 	BP = bp;
+	vertShaderFile = VertShader;
+	fragShaderFile = FragShader;
+	layouts.clear();
+	for (DescriptorSetLayout* layout : D) {
+		layouts.push_back(layout->descriptorSetLayout);
+	}
+	vertexFormat = format;
+	create();
+
+	BP->pipelines.push_back(this);
+	BP->watchFile(VertShader);
+	BP->watchFile(FragShader);
+}
+
+// Build the pipeline and its layout from the stored shaders, layouts and vertex format
+void Pipeline::create() {
+	StartupZone zone(vertShaderFile + " + " + fragShaderFile, "Pipeline");
 	
-	auto vertShaderCode = readFile(VertShader);
-	auto fragShaderCode = readFile(FragShader);
+	auto vertShaderCode = readFile(vertShaderFile);
+	auto fragShaderCode = readFile(fragShaderFile);
 	
 	std::cout << "Vertex shader len: " <<
 				vertShaderCode.size() << "\n";
@@ -1888,8 +3131,10 @@ void Pipeline::init(BaseProject *bp, const std::string& VertShader, const std::s
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 	vertexInputInfo.sType =
 			VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	auto bindingDescription = vertexFormat == VERTEX_COMPACT ? CompactVertex::getBindingDescription() :
+														 Vertex::getBindingDescription();
+	auto attributeDescriptions = vertexFormat == VERTEX_COMPACT ? CompactVertex::getAttributeDescriptions() :
+															Vertex::getAttributeDescriptions();
 			
 	vertexInputInfo.vertexBindingDescriptionCount = 1;
 	vertexInputInfo.vertexAttributeDescriptionCount =
@@ -1982,18 +3227,18 @@ void Pipeline::init(BaseProject *bp, const std::string& VertShader, const std::s
 	colorBlending.blendConstants[3] = 0.0f; // Optional
 	
 	// Lesson 21
-	std::vector<VkDescriptorSetLayout> DSL(D.size());
-	for(int i = 0; i < D.size(); i++) {
-		DSL[i] = D[i]->descriptorSetLayout;
-	}
 	
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType =
 		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = DSL.size();
-	pipelineLayoutInfo.pSetLayouts = DSL.data();
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+	pipelineLayoutInfo.setLayoutCount = layouts.size();
+	pipelineLayoutInfo.pSetLayouts = layouts.data();
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(MeshQuantization);
+	pipelineLayoutInfo.pushConstantRangeCount = vertexFormat == VERTEX_COMPACT ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges = vertexFormat == VERTEX_COMPACT ? &pushConstantRange : nullptr;
 	
 	VkResult result = vkCreatePipelineLayout(BP->device, &pipelineLayoutInfo, nullptr,
 				&pipelineLayout);
@@ -2088,6 +3333,21 @@ void Pipeline::cleanup() {
 		vkDestroyPipelineLayout(BP->device, pipelineLayout, nullptr);
 }
 
+bool Pipeline::usesShader(const std::string& file) {
+	return file == vertShaderFile || file == fragShaderFile;
+}
+
+std::function<void()> Pipeline::prepareReload() {
+	// Built aside: a shader that fails to load leaves the pipeline as it is
+	Pipeline fresh = *this;
+	fresh.create();
+	return [this, fresh]() {
+		cleanup();
+		graphicsPipeline = fresh.graphicsPipeline;
+		pipelineLayout = fresh.pipelineLayout;
+	};
+}
+
 void DescriptorSetLayout::init(BaseProject *bp, std::vector<DescriptorSetLayoutBinding> B) {
 	BP = bp;
 	
@@ -2121,6 +3381,7 @@ void DescriptorSetLayout::cleanup() {
 void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 						 std::vector<DescriptorSetElement> E) {
 	BP = bp;
+	StartupZone zone("DescriptorSet::init", "Descriptor sets");
 	
 	// Create uniform buffer
 	uniformBuffers.resize(E.size());
@@ -2136,7 +3397,7 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 				BP->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 									 	 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 									 	 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-									 	 uniformBuffers[j][i], uniformBuffersMemory[j][i]);
+									 	 uniformBuffers[j][i], uniformBuffersMemory[j][i], MEM_UNIFORM);
 			}
 			toFree[j] = true;
 		} else {
@@ -2201,12 +3462,578 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 
 }
 
+const char* MemoryRegistry::tagName(MemoryTag tag) {
+	switch (tag) {
+		case MEM_VERTEX: return "Model vertex";
+		case MEM_INDEX: return "Model index";
+		case MEM_TEXTURE: return "Texture";
+		case MEM_UNIFORM: return "Uniform";
+		case MEM_DEPTH: return "Depth";
+		case MEM_STAGING: return "Staging";
+		case MEM_OFFSCREEN: return "Offscreen";
+		default: return "Other";
+	}
+}
+
+void MemoryRegistry::init(uint32_t maxMemoryAllocationCount) {
+	maxAllocations = maxMemoryAllocationCount;
+}
+
+void MemoryRegistry::add(VkDeviceMemory memory, MemoryTag tag, VkDeviceSize size) {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	allocations[memory] = { tag, size };
+
+	for (TagStats* stats : { &tags[tag], &total }) {
+		stats->liveBytes += size;
+		stats->peakBytes = std::max(stats->peakBytes, stats->liveBytes);
+		stats->allocations++;
+	}
+
+	// Every allocation counts towards maxMemoryAllocationCount whatever its size
+	if (!warned && total.allocations >= maxAllocations * 0.8) {
+		warned = true;
+		std::cout << "Warning: " << total.allocations << " device memory allocations, the limit is "
+				  << maxAllocations << "\n";
+	}
+}
+
+void MemoryRegistry::remove(VkDeviceMemory memory) {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	auto found = allocations.find(memory);
+	if (found == allocations.end()) {
+		return;
+	}
+
+	for (TagStats* stats : { &tags[found->second.first], &total }) {
+		stats->liveBytes -= found->second.second;
+		stats->allocations--;
+	}
+	allocations.erase(found);
+}
+
+void MemoryRegistry::dump() {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::cout << "---------- Device memory ----------\n";
+	std::cout << std::setw(14) << "" << std::setw(12) << "live MB" << std::setw(13) << "allocations"
+			  << std::setw(12) << "peak MB" << "\n";
+	std::cout << std::fixed << std::setprecision(2);
+	for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+		if (tags[tag].peakBytes == 0) {
+			continue;
+		}
+		std::cout << std::setw(14) << tagName((MemoryTag)tag) << std::setw(12) << tags[tag].liveBytes / 1048576.0
+				  << std::setw(13) << tags[tag].allocations << std::setw(12) << tags[tag].peakBytes / 1048576.0 << "\n";
+	}
+	std::cout << std::setw(14) << "Total" << std::setw(12) << total.liveBytes / 1048576.0
+			  << std::setw(13) << total.allocations << std::setw(12) << total.peakBytes / 1048576.0 << "\n";
+	std::cout << std::defaultfloat << "Allocations: " << total.allocations << " of " << maxAllocations << "\n";
+}
+
+void GpuTimer::init(BaseProject *bp, uint32_t images, uint32_t zonesPerImage, std::string file) {
+	BP = bp;
+	maxZones = zonesPerImage;
+	outputFile = file;
+
+	QueueFamilyIndices indices = BP->findQueueFamilies(BP->physicalDevice);
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(BP->physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(BP->physicalDevice, &queueFamilyCount,
+							queueFamilies.data());
+	uint32_t validBits = queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+	if (validBits == 0) {
+		std::cout << "GPU timing disabled: the graphics queue does not support timestamps\n";
+		return;
+	}
+	timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(BP->physicalDevice, &properties);
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = images * maxZones * 2;
+
+	VkResult result = vkCreateQueryPool(BP->device, &poolInfo, nullptr, &queryPool);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to create timestamp query pool!");
+	}
+
+	zoneNames.resize(images);
+	submitted.resize(images, false);
+}
+
+void GpuTimer::reset(VkCommandBuffer commandBuffer, int currentImage) {
+	if (!isEnabled() || currentImage >= (int)zoneNames.size()) {
+		return;
+	}
+	zoneNames[currentImage].clear();
+	vkCmdResetQueryPool(commandBuffer, queryPool, currentImage * maxZones * 2, maxZones * 2);
+}
+
+// Returns the zone to pass to endZone, -1 if the timer is disabled or full
+int GpuTimer::beginZone(VkCommandBuffer commandBuffer, int currentImage, const std::string& name) {
+	if (!isEnabled() || currentImage >= (int)zoneNames.size() ||
+		zoneNames[currentImage].size() >= maxZones) {
+		return -1;
+	}
+	int zone = zoneNames[currentImage].size();
+	zoneNames[currentImage].push_back(name);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool,
+						(currentImage * maxZones + zone) * 2);
+	return zone;
+}
+
+void GpuTimer::endZone(VkCommandBuffer commandBuffer, int currentImage, int zone) {
+	if (zone < 0) {
+		return;
+	}
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool,
+						(currentImage * maxZones + zone) * 2 + 1);
+}
+
+void GpuTimer::markSubmitted(int currentImage) {
+	if (isEnabled() && currentImage < (int)submitted.size()) {
+		submitted[currentImage] = true;
+	}
+}
+
+// Must be called only after the fence of the last submission of currentImage
+void GpuTimer::collect(int currentImage) {
+	if (!isEnabled() || currentImage >= (int)zoneNames.size() ||
+		!submitted[currentImage] || zoneNames[currentImage].empty()) {
+		return;
+	}
+	submitted[currentImage] = false;
+
+	// Each query returns its value followed by its availability
+	uint32_t queryCount = zoneNames[currentImage].size() * 2;
+	std::vector<uint64_t> results(queryCount * 2);
+	vkGetQueryPoolResults(BP->device, queryPool, currentImage * maxZones * 2, queryCount,
+						  results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+						  VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	nlohmann::json zones = nlohmann::json::array();
+	for (size_t z = 0; z < zoneNames[currentImage].size(); z++) {
+		uint64_t begin = results[z * 4 + 0];
+		uint64_t end = results[z * 4 + 2];
+		if (results[z * 4 + 1] == 0 || results[z * 4 + 3] == 0) {
+			continue;
+		}
+		double ms = ((end - begin) & timestampMask) * timestampPeriod / 1000000.0;
+		zones.push_back({ {"name", zoneNames[currentImage][z]}, {"ms", ms} });
+
+		ZoneStats& stats = summary[zoneNames[currentImage][z]];
+		stats.totalMs += ms;
+		stats.maxMs = std::max(stats.maxMs, ms);
+		stats.count++;
+	}
+	frames.push_back({ {"frame", collectedFrames++}, {"image", currentImage}, {"zones", zones} });
+}
+
+void GpuTimer::writeJSON() {
+	nlohmann::json zonesSummary = nlohmann::json::object();
+	for (const auto& zone : summary) {
+		zonesSummary[zone.first] = {
+			{"avgMs", zone.second.totalMs / zone.second.count},
+			{"maxMs", zone.second.maxMs},
+			{"count", zone.second.count}
+		};
+	}
+
+	nlohmann::json output = {
+		{"timestampPeriodNs", timestampPeriod},
+		{"summary", zonesSummary},
+		{"frames", frames}
+	};
+
+	std::ofstream file(outputFile);
+	if (!file.is_open()) {
+		std::cout << "failed to write GPU timings to " << outputFile << "\n";
+		return;
+	}
+	file << output.dump(1, '\t');
+	std::cout << "GPU timings of " << collectedFrames << " frames saved to " << outputFile << "\n";
+}
+
+void UploadBatch::init(BaseProject *bp) {
+	BP = bp;
+
+	BP->createBuffer(ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 ringBuffer, ringMemory, MEM_STAGING);
+	void* data;
+	VkResult result = vkMapMemory(BP->device, ringMemory, 0, ringSize, 0, &data);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to map the staging ring!");
+	}
+	ringData = (uint8_t*)data;
+}
+
+void UploadBatch::begin() {
+	open = true;
+}
+
+bool UploadBatch::usesTransferQueue() {
+	return open && BP->transferQueue != VK_NULL_HANDLE;
+}
+
+static VkCommandBuffer beginUploadCommands(VkDevice device, VkCommandPool commandPool) {
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = commandPool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	VkResult result = vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to allocate upload command buffer!");
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	return commandBuffer;
+}
+
+// Copies and layout transitions to TRANSFER_DST only
+VkCommandBuffer UploadBatch::recordTransfer() {
+	if (!usesTransferQueue()) {
+		return recordGraphics();
+	}
+	if (transferCommands == VK_NULL_HANDLE) {
+		transferCommands = beginUploadCommands(BP->device, BP->transferCommandPool);
+	}
+	return transferCommands;
+}
+
+VkCommandBuffer UploadBatch::recordGraphics() {
+	if (graphicsCommands == VK_NULL_HANDLE) {
+		graphicsCommands = beginUploadCommands(BP->device, BP->commandPool);
+	}
+	return graphicsCommands;
+}
+
+// The copies into image are done: make them visible to the graphics queue in newLayout
+void UploadBatch::handOffImage(VkImage image, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout,
+							   VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+	bool ownershipTransfer = usesTransferQueue();
+	if (!ownershipTransfer && oldLayout == newLayout) {
+		// Same queue: the next barrier on the image already waits for the copies
+		return;
+	}
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = ownershipTransfer ? BP->transferQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = ownershipTransfer ? BP->graphicsQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	if (!ownershipTransfer) {
+		VkCommandBuffer commandBuffer = BP->beginSingleTimeCommands();
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dstAccess;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+							 0, nullptr, 0, nullptr, 1, &barrier);
+		BP->endSingleTimeCommands(commandBuffer);
+		return;
+	}
+
+	// Release on the transfer queue, then acquire with the same barrier on the graphics queue
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(recordTransfer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+						 0, nullptr, 0, nullptr, 1, &barrier);
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(recordGraphics(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+						 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void UploadBatch::handOffBuffer(VkBuffer buffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+	bool ownershipTransfer = usesTransferQueue();
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = ownershipTransfer ? BP->transferQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = ownershipTransfer ? BP->graphicsQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	if (!ownershipTransfer) {
+		VkCommandBuffer commandBuffer = BP->beginSingleTimeCommands();
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dstAccess;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+							 0, nullptr, 1, &barrier, 0, nullptr);
+		BP->endSingleTimeCommands(commandBuffer);
+		return;
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(recordTransfer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+						 0, nullptr, 1, &barrier, 0, nullptr);
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(recordGraphics(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+						 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// Offsets are aligned for the buffer to image copies of any format. The ring is never filled completely,
+// so that ringHead == ringTail always means empty
+bool UploadBatch::ringAllocate(VkDeviceSize size, VkDeviceSize& offset) {
+	// Restart from the beginning only when nothing is submitted: the ringEnd of a submission that did not
+	// allocate from the ring is still used by collect
+	if (ringHead == ringTail && inFlight.empty()) {
+		ringHead = ringTail = 0;
+	}
+	VkDeviceSize start = (ringHead + 15) & ~(VkDeviceSize)15;
+	if (ringHead >= ringTail) {
+		if (start + size <= ringSize) {
+			offset = start;
+		} else if (size < ringTail) {
+			// The end of the ring is skipped, it is given back together with this allocation
+			offset = 0;
+		} else {
+			return false;
+		}
+	} else if (start + size < ringTail) {
+		offset = start;
+	} else {
+		return false;
+	}
+	ringHead = offset + size;
+	return true;
+}
+
+// Staging memory for size bytes, valid until the copies from it are recorded and releaseStaging() is called
+StagingAllocation UploadBatch::allocateStaging(VkDeviceSize size) {
+	StagingAllocation allocation{};
+	VkDeviceSize offset;
+	if (size + 16 < ringSize) {
+		if (!ringAllocate(size, offset)) {
+			// Full: wait for the copies recorded so far, then the whole ring is free
+			TRACE_ZONE("Staging ring full");
+			submit();
+			collect(true);
+			if (!ringAllocate(size, offset)) {
+				throw std::runtime_error("failed to allocate staging memory!");
+			}
+		}
+		allocation.buffer = ringBuffer;
+		allocation.offset = offset;
+		allocation.data = ringData + offset;
+		return allocation;
+	}
+
+	VkDeviceMemory memory;
+	BP->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 allocation.buffer, memory, MEM_STAGING);
+	vkMapMemory(BP->device, memory, 0, size, 0, &allocation.data);
+	stagingBuffers.push_back({ allocation.buffer, memory });
+	return allocation;
+}
+
+// The copies from the staging allocations are recorded: outside of a batch they are also complete
+void UploadBatch::releaseStaging() {
+	if (open) {
+		return;
+	}
+	for (auto const& staging : stagingBuffers) {
+		vkDestroyBuffer(BP->device, staging.first, nullptr);
+		BP->freeMemory(staging.second);
+	}
+	stagingBuffers.clear();
+	collect(false);
+	if (inFlight.empty()) {
+		ringHead = ringTail = 0;
+	}
+}
+
+// Submit the recorded commands without waiting for them
+void UploadBatch::submit() {
+	if (transferCommands == VK_NULL_HANDLE && graphicsCommands == VK_NULL_HANDLE) {
+		return;
+	}
+	// The graphics submission carries the fence, even when it only waits for the copies
+	recordGraphics();
+
+	// The GPU side runs in parallel, this is only the cost of the submission
+	StartupZone zone("Upload batch " + std::to_string(submissions), "Upload submit");
+	Submission submission{};
+	submission.transferCommands = transferCommands;
+	submission.graphicsCommands = graphicsCommands;
+	submission.stagingBuffers.swap(stagingBuffers);
+	submission.ringEnd = ringHead;
+
+	VkResult result;
+	if (!freeFences.empty()) {
+		submission.fence = freeFences.back();
+		freeFences.pop_back();
+	} else {
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		result = vkCreateFence(BP->device, &fenceInfo, nullptr, &submission.fence);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to create upload fence!");
+		}
+	}
+
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkSubmitInfo graphicsSubmit{};
+	graphicsSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	graphicsSubmit.commandBufferCount = 1;
+	graphicsSubmit.pCommandBuffers = &submission.graphicsCommands;
+
+	if (transferCommands != VK_NULL_HANDLE) {
+		if (!freeSemaphores.empty()) {
+			submission.copied = freeSemaphores.back();
+			freeSemaphores.pop_back();
+		} else {
+			VkSemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			result = vkCreateSemaphore(BP->device, &semaphoreInfo, nullptr, &submission.copied);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create upload semaphore!");
+			}
+		}
+
+		vkEndCommandBuffer(transferCommands);
+		VkSubmitInfo transferSubmit{};
+		transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		transferSubmit.commandBufferCount = 1;
+		transferSubmit.pCommandBuffers = &submission.transferCommands;
+		transferSubmit.signalSemaphoreCount = 1;
+		transferSubmit.pSignalSemaphores = &submission.copied;
+		result = vkQueueSubmit(BP->transferQueue, 1, &transferSubmit, VK_NULL_HANDLE);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to submit transfer command buffer!");
+		}
+
+		graphicsSubmit.waitSemaphoreCount = 1;
+		graphicsSubmit.pWaitSemaphores = &submission.copied;
+		graphicsSubmit.pWaitDstStageMask = &waitStage;
+	}
+
+	vkEndCommandBuffer(graphicsCommands);
+	result = vkQueueSubmit(BP->graphicsQueue, 1, &graphicsSubmit, submission.fence);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to submit upload command buffer!");
+	}
+
+	inFlight.push_back(std::move(submission));
+	transferCommands = VK_NULL_HANDLE;
+	graphicsCommands = VK_NULL_HANDLE;
+	submissions++;
+}
+
+// Give back the staging memory of the completed submissions, or of all of them after waiting
+void UploadBatch::collect(bool wait) {
+	size_t completed = 0;
+	for (; completed < inFlight.size(); completed++) {
+		Submission& submission = inFlight[completed];
+		if (wait) {
+			vkWaitForFences(BP->device, 1, &submission.fence, VK_TRUE, UINT64_MAX);
+		} else if (vkGetFenceStatus(BP->device, submission.fence) != VK_SUCCESS) {
+			break;
+		}
+
+		if (submission.transferCommands != VK_NULL_HANDLE) {
+			vkFreeCommandBuffers(BP->device, BP->transferCommandPool, 1, &submission.transferCommands);
+			// Waited by the graphics submission, so it is unsignaled again
+			freeSemaphores.push_back(submission.copied);
+		}
+		vkFreeCommandBuffers(BP->device, BP->commandPool, 1, &submission.graphicsCommands);
+		vkResetFences(BP->device, 1, &submission.fence);
+		freeFences.push_back(submission.fence);
+		for (auto const& staging : submission.stagingBuffers) {
+			vkDestroyBuffer(BP->device, staging.first, nullptr);
+			BP->freeMemory(staging.second);
+		}
+		ringTail = submission.ringEnd;
+	}
+	inFlight.erase(inFlight.begin(), inFlight.begin() + completed);
+}
+
+// Submit what is left, the rendering can start while it runs
+void UploadBatch::end() {
+	submit();
+	open = false;
+}
+
+void UploadBatch::cleanup() {
+	collect(true);
+	for (VkFence fence : freeFences) {
+		vkDestroyFence(BP->device, fence, nullptr);
+	}
+	freeFences.clear();
+	for (VkSemaphore semaphore : freeSemaphores) {
+		vkDestroySemaphore(BP->device, semaphore, nullptr);
+	}
+	freeSemaphores.clear();
+	if (ringBuffer != VK_NULL_HANDLE) {
+		vkUnmapMemory(BP->device, ringMemory);
+		vkDestroyBuffer(BP->device, ringBuffer, nullptr);
+		BP->freeMemory(ringMemory);
+		ringBuffer = VK_NULL_HANDLE;
+	}
+}
+
+void GpuTimer::cleanup() {
+	if (!isEnabled()) {
+		return;
+	}
+	writeJSON();
+	vkDestroyQueryPool(BP->device, queryPool, nullptr);
+	queryPool = VK_NULL_HANDLE;
+}
+
+void DescriptorSet::updateTexture(int binding, Texture *tex) {
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = tex->textureImageView;
+	imageInfo.sampler = tex->textureSampler;
+
+	for (size_t i = 0; i < descriptorSets.size(); i++) {
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSets[i];
+		descriptorWrite.dstBinding = binding;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(BP->device, 1, &descriptorWrite, 0, nullptr);
+	}
+}
+
 void DescriptorSet::cleanup() {
 	for(int j = 0; j < uniformBuffers.size(); j++) {
 		if(toFree[j]) {
 			for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
 				vkDestroyBuffer(BP->device, uniformBuffers[j][i], nullptr);
-				vkFreeMemory(BP->device, uniformBuffersMemory[j][i], nullptr);
+				BP->freeMemory(uniformBuffersMemory[j][i]);
 			}
 		}
 	}
@@ -0,0 +1,204 @@
+// Scene description read from a JSON file (Assets/scenes): the assets of the level, the game objects drawn
+// with them and their hitboxes, and the effects. Nothing is created here, MyProject sizes the descriptor pool
+// from the counts and then loads all the assets at once
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cstdint>
+#include <stdexcept>
+
+#include <json.hpp>
+#include <glm/glm.hpp>
+
+// Model and texture are relative to Assets/models and Assets/textures, an empty texture means the one
+// embedded in a .glb model
+struct SceneAsset {
+	std::string name;
+	std::string model;
+	std::string texture;
+	// GPU timer section the asset is drawn in, the sections are drawn in the order they first appear
+	std::string group;
+};
+
+enum SceneObjectType {
+	SCENE_BIRD,
+	SCENE_PIG,
+	SCENE_DECORATION,
+	SCENE_CANNON_BOT,
+	SCENE_CANNON_TOP,
+	SCENE_TRAJECTORY,
+	SCENE_GAME_OVER
+};
+
+struct SceneObject {
+	SceneObjectType type;
+	std::string asset;
+	// Relative to Assets/models: one for birds and pigs, any number for decorations
+	std::vector<std::string> hitBoxes;
+	// Pigs and decorations only, the hitboxes are moved with the model
+	glm::vec3 offset = glm::vec3(0.0f);
+	// Shown when the level starts: birds wait in the cannon and the game over sign waits for the last pig
+	bool visible = true;
+	// Used as a model by --stress
+	bool stress = false;
+};
+
+// boom pops at the cannon when a bird is shot, hit on a pig and miss on a decoration
+struct SceneEffect {
+	std::string role;
+	std::string asset;
+	float rotationSpeed;
+	float scaleSpeed;
+	float maxScale;
+};
+
+struct Scene {
+	std::vector<SceneAsset> assets;
+	// An object with a count in the file is repeated count times
+	std::vector<SceneObject> objects;
+	std::vector<SceneEffect> effects;
+
+	// One descriptor set for every object and every effect
+	uint32_t descriptorSets() const {
+		return (uint32_t)(objects.size() + effects.size());
+	}
+
+	uint32_t count(SceneObjectType type) const {
+		uint32_t n = 0;
+		for (const SceneObject& object : objects) {
+			n += object.type == type ? 1 : 0;
+		}
+		return n;
+	}
+};
+
+// Parse and check the scene file, every error names the file and the entry
+inline Scene loadScene(const std::string& path) {
+	std::ifstream in(path);
+	if (!in.is_open()) {
+		throw std::runtime_error("failed to open scene " + path + "!");
+	}
+	nlohmann::json file;
+	try {
+		in >> file;
+	}
+	catch (const nlohmann::json::exception& e) {
+		throw std::runtime_error("failed to parse scene " + path + ": " + e.what());
+	}
+
+	const std::map<std::string, SceneObjectType> types = {
+		{ "bird", SCENE_BIRD }, { "pig", SCENE_PIG }, { "decoration", SCENE_DECORATION },
+		{ "cannonBot", SCENE_CANNON_BOT }, { "cannonTop", SCENE_CANNON_TOP },
+		{ "trajectory", SCENE_TRAJECTORY }, { "gameOver", SCENE_GAME_OVER }
+	};
+	auto fail = [&](const std::string& message) {
+		throw std::runtime_error("scene " + path + ": " + message + "!");
+	};
+
+	Scene scene;
+	std::set<std::string> assetNames;
+	try {
+		for (const nlohmann::json& entry : file.at("assets")) {
+			SceneAsset asset;
+			asset.name = entry.at("name").get<std::string>();
+			asset.model = entry.at("model").get<std::string>();
+			asset.texture = entry.value("texture", std::string());
+			asset.group = entry.value("group", std::string("Scene"));
+			if (!assetNames.insert(asset.name).second) {
+				fail("asset " + asset.name + " is declared twice");
+			}
+			scene.assets.push_back(asset);
+		}
+
+		for (const nlohmann::json& entry : file.at("objects")) {
+			std::string type = entry.at("type").get<std::string>();
+			auto found = types.find(type);
+			if (found == types.end()) {
+				fail("unknown object type " + type);
+			}
+			SceneObject object;
+			object.type = found->second;
+			object.asset = entry.at("asset").get<std::string>();
+			if (assetNames.count(object.asset) == 0) {
+				fail("object of unknown asset " + object.asset);
+			}
+			object.hitBoxes = entry.value("hitBoxes", std::vector<std::string>());
+			bool needsHitBox = object.type == SCENE_BIRD || object.type == SCENE_PIG;
+			if (needsHitBox && object.hitBoxes.size() != 1) {
+				fail("the " + type + " of " + object.asset + " needs exactly one hit box");
+			}
+			if (!needsHitBox && object.type != SCENE_DECORATION && !object.hitBoxes.empty()) {
+				fail("the " + type + " of " + object.asset + " cannot have hit boxes");
+			}
+			if (entry.contains("offset")) {
+				if (object.type != SCENE_PIG && object.type != SCENE_DECORATION) {
+					fail("only pigs and decorations can be moved by an offset");
+				}
+				std::vector<float> offset = entry.at("offset").get<std::vector<float>>();
+				if (offset.size() != 3) {
+					fail("the offset of " + object.asset + " needs 3 values");
+				}
+				object.offset = glm::vec3(offset[0], offset[1], offset[2]);
+			}
+			object.visible = entry.value("visible", object.type != SCENE_BIRD && object.type != SCENE_GAME_OVER);
+			object.stress = entry.value("stress", false);
+			if (object.stress && object.type != SCENE_PIG && object.type != SCENE_DECORATION) {
+				fail("only pigs and decorations can be copied by --stress");
+			}
+			if (object.stress && object.hitBoxes.empty()) {
+				fail("the copies of " + object.asset + " made by --stress need a hit box to be placed");
+			}
+			int count = entry.value("count", 1);
+			for (int i = 0; i < count; i++) {
+				scene.objects.push_back(object);
+			}
+		}
+
+		for (const nlohmann::json& entry : file.at("effects")) {
+			SceneEffect effect;
+			effect.role = entry.at("role").get<std::string>();
+			effect.asset = entry.at("asset").get<std::string>();
+			effect.rotationSpeed = entry.at("rotationSpeed").get<float>();
+			effect.scaleSpeed = entry.at("scaleSpeed").get<float>();
+			effect.maxScale = entry.at("maxScale").get<float>();
+			if (assetNames.count(effect.asset) == 0) {
+				fail("effect of unknown asset " + effect.asset);
+			}
+			scene.effects.push_back(effect);
+		}
+	}
+	catch (const nlohmann::json::exception& e) {
+		fail(e.what());
+	}
+
+	// The game logic expects one cannon, its trajectory, the game over sign and the three effects
+	if (scene.count(SCENE_BIRD) == 0) {
+		fail("no birds");
+	}
+	if (scene.count(SCENE_CANNON_BOT) != 1 || scene.count(SCENE_CANNON_TOP) != 1) {
+		fail("there must be one cannonBot and one cannonTop");
+	}
+	if (scene.count(SCENE_TRAJECTORY) == 0) {
+		fail("no trajectory spheres");
+	}
+	if (scene.count(SCENE_GAME_OVER) != 1) {
+		fail("there must be one gameOver");
+	}
+	for (std::string role : { "boom", "hit", "miss" }) {
+		int declared = 0;
+		for (const SceneEffect& effect : scene.effects) {
+			declared += effect.role == role ? 1 : 0;
+		}
+		if (declared != 1) {
+			fail("there must be one " + role + " effect");
+		}
+	}
+	if (scene.effects.size() != 3) {
+		fail("unknown effect role");
+	}
+	return scene;
+}
@@ -0,0 +1,199 @@
+// Startup profiler: wall time of every loading phase (OBJ parse, PNG decode, upload, ...) of every asset
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+
+#include "Tracer.hpp"
+
+class StartupProfiler
+{
+protected:
+	StartupProfiler()
+	{}
+
+	bool enabled = false;
+	std::string outputFile;
+
+	std::mutex entriesMutex;
+	// item (asset file) -> phase -> milliseconds
+	std::map<std::string, std::map<std::string, double>> items;
+	std::map<std::string, double> phases;
+	// Time of the outermost zones of each thread: unlike the phases, which add up the loading threads,
+	// the time of one thread cannot exceed the wall time
+	std::map<std::thread::id, double> threads;
+	std::thread::id mainThread;
+
+	std::chrono::steady_clock::time_point startupBegin;
+	double startupMs = 0;
+
+public:
+
+	StartupProfiler(StartupProfiler& other) = delete;
+
+	void operator=(const StartupProfiler&) = delete;
+
+	static StartupProfiler* GetInstance();
+
+	// Collect the startup times and write the summary to file at exit (empty file = console only)
+	void start(std::string file) {
+		outputFile = file;
+		enabled = true;
+	}
+
+	bool isEnabled() {
+		return enabled;
+	}
+
+	// Called around the whole initialization to compare the phases with the total wall time
+	void beginStartup() {
+		mainThread = std::this_thread::get_id();
+		startupBegin = std::chrono::steady_clock::now();
+	}
+
+	void endStartup() {
+		startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+	}
+
+	// outermost is false for a zone opened inside another zone of the same thread
+	void record(const std::string& item, const std::string& phase, double ms, bool outermost) {
+		std::lock_guard<std::mutex> lock(entriesMutex);
+		items[item][phase] += ms;
+		phases[phase] += ms;
+		if (outermost) {
+			threads[std::this_thread::get_id()] += ms;
+		}
+	}
+
+	// Milliseconds spent so far by the item in the phase
+	double getTime(const std::string& item, const std::string& phase) {
+		std::lock_guard<std::mutex> lock(entriesMutex);
+		auto found = items.find(item);
+		if (found == items.end() || found->second.count(phase) == 0) {
+			return 0;
+		}
+		return found->second.at(phase);
+	}
+
+	// Print the time of each thread, the total of each phase, then the items sorted by their total time
+	void report() {
+		if (!enabled) {
+			return;
+		}
+		enabled = false;
+
+		std::lock_guard<std::mutex> lock(entriesMutex);
+		std::vector<std::pair<double, std::string>> sortedItems;
+		for (auto const& item : items) {
+			double total = 0;
+			for (auto const& phase : item.second) {
+				total += phase.second;
+			}
+			sortedItems.push_back({ total, item.first });
+		}
+		std::sort(sortedItems.rbegin(), sortedItems.rend());
+
+		std::vector<std::pair<double, std::string>> sortedPhases;
+		for (auto const& phase : phases) {
+			sortedPhases.push_back({ phase.second, phase.first });
+		}
+		std::sort(sortedPhases.rbegin(), sortedPhases.rend());
+
+		double mainMs = threads.count(mainThread) ? threads[mainThread] : 0;
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(2);
+		out << "---------- Startup profile ----------\n";
+		out << "Startup wall time: " << startupMs << " ms (" << std::max(startupMs - mainMs, 0.0)
+			<< " ms of the main thread outside the measured phases)\n\n";
+		out << "Threads (time in the measured phases):\n";
+		out << std::setw(12) << mainMs << " ms  main\n";
+		int loadingThread = 0;
+		for (auto const& thread : threads) {
+			if (thread.first != mainThread) {
+				out << std::setw(12) << thread.second << " ms  loading thread " << ++loadingThread << "\n";
+			}
+		}
+		out << "\nPhases (summed over the threads, they can exceed the wall time):\n";
+		for (auto const& phase : sortedPhases) {
+			out << std::setw(12) << phase.first << " ms  " << phase.second << "\n";
+		}
+		out << "\nItems:\n";
+		for (auto const& item : sortedItems) {
+			out << std::setw(12) << item.first << " ms  " << item.second << " (";
+			bool first = true;
+			for (auto const& phase : items[item.second]) {
+				out << (first ? "" : ", ") << phase.first << " " << phase.second;
+				first = false;
+			}
+			out << ")\n";
+		}
+
+		std::cout << out.str();
+		if (!outputFile.empty()) {
+			std::ofstream file(outputFile);
+			if (!file.is_open()) {
+				std::cout << "failed to write the startup profile to " << outputFile << "\n";
+				return;
+			}
+			file << out.str();
+		}
+	}
+};
+StartupProfiler* StartupProfiler::GetInstance()
+{
+	// Used also by the loading threads: the local static is created only once
+	static StartupProfiler* singleton_ = new StartupProfiler();
+	return singleton_;
+}
+
+// Measures one phase of the loading of an item until stop() or its destruction, it also appears in the trace
+class StartupZone {
+	std::string item;
+	const char* phase;
+	TraceZone traceZone;
+	bool running;
+	bool outermost = false;
+	std::chrono::steady_clock::time_point begin;
+
+public:
+	StartupZone(const std::string& itemName, const char* phaseName) :
+		item(itemName), phase(phaseName), traceZone(phaseName) {
+		running = StartupProfiler::GetInstance()->isEnabled();
+		if (running) {
+			outermost = depth()++ == 0;
+			begin = std::chrono::steady_clock::now();
+		}
+	}
+
+	// Zones open on this thread
+	static int& depth() {
+		thread_local int open = 0;
+		return open;
+	}
+
+	void stop() {
+		traceZone.stop();
+		if (running) {
+			running = false;
+			depth()--;
+			StartupProfiler::GetInstance()->record(item, phase,
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count(), outermost);
+		}
+	}
+
+	~StartupZone() {
+		stop();
+	}
+
+	StartupZone(const StartupZone&) = delete;
+	void operator=(const StartupZone&) = delete;
+};
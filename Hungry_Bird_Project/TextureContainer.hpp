@@ -0,0 +1,85 @@
+// Texture container built offline by Tools/TextureCompiler.cpp: the whole mip chain already block compressed
+// (BC1 or BC7), so it is copied into the image without decoding the PNG or generating the mips on the GPU
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "MeshCache.hpp"
+
+const uint32_t TEXTURE_CONTAINER_MAGIC = 0x58544248;	// "HBTX"
+const uint32_t TEXTURE_CONTAINER_VERSION = 2;
+const uint32_t TEXTURE_CONTAINER_MAX_LEVELS = 16;
+// The container of image.png is image.png.hbtx
+const std::string TEXTURE_CONTAINER_EXTENSION = ".hbtx";
+
+enum TextureContainerFormat : uint32_t {
+	TEXTURE_FORMAT_BC1 = 1,		// RGB, 8 bytes every 4x4 block
+	TEXTURE_FORMAT_BC7 = 2		// RGBA, 16 bytes every 4x4 block
+};
+
+struct TextureContainerLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+	uint64_t size;
+};
+
+// The file starts with this header, followed by the blocks of every level from the largest one
+struct TextureContainerHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t mipLevels;
+	// Size and modification time of the image the container was built from, like the mesh cache:
+	// if either is different the container must be built again
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	TextureContainerLevel levels[TEXTURE_CONTAINER_MAX_LEVELS];
+};
+
+inline uint32_t textureBlockBytes(uint32_t format) {
+	return format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+}
+
+inline uint64_t textureLevelSize(uint32_t format, uint32_t width, uint32_t height) {
+	return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * textureBlockBytes(format);
+}
+
+// Map the container of source, false if it is missing, invalid or older than source. On success
+// header points inside file, which must stay open while the levels are used
+inline bool loadTextureContainer(const std::string& source, MappedFile& file, const TextureContainerHeader*& header) {
+	std::string path = source + TEXTURE_CONTAINER_EXTENSION;
+	if (!file.open(path)) {
+		return false;
+	}
+	if (file.size() < sizeof(TextureContainerHeader)) {
+		file.close();
+		return false;
+	}
+	header = (const TextureContainerHeader*)file.data();
+	bool valid = header->magic == TEXTURE_CONTAINER_MAGIC && header->version == TEXTURE_CONTAINER_VERSION &&
+				 (header->format == TEXTURE_FORMAT_BC1 || header->format == TEXTURE_FORMAT_BC7) &&
+				 header->mipLevels > 0 && header->mipLevels <= TEXTURE_CONTAINER_MAX_LEVELS;
+	for (uint32_t i = 0; valid && i < header->mipLevels; i++) {
+		const TextureContainerLevel& level = header->levels[i];
+		valid = level.width > 0 && level.height > 0 &&
+				level.offset % 16 == 0 && level.offset + level.size <= file.size() &&
+				level.size == textureLevelSize(header->format, level.width, level.height);
+	}
+	if (!valid) {
+		std::cout << "invalid texture container " << path << "\n";
+		file.close();
+		return false;
+	}
+
+	uint64_t size;
+	int64_t time;
+	if (MeshCache::sourceInfo(source, size, time) && (size != header->sourceSize || time != header->sourceTime)) {
+		std::cout << "texture container " << path << " is out of date, run TextureCompiler again\n";
+		file.close();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,87 @@
+// Worker threads used to parse models and decode images while the main thread talks to Vulkan
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex tasksMutex;
+	std::condition_variable tasksAvailable;
+	bool stopping = false;
+
+	void work() {
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(tasksMutex);
+				tasksAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+				if (tasks.empty()) {
+					return;
+				}
+				task = std::move(tasks.front());
+				tasks.pop();
+			}
+			task();
+		}
+	}
+
+public:
+	ThreadPool() {}
+	ThreadPool(const ThreadPool&) = delete;
+	void operator=(const ThreadPool&) = delete;
+
+	~ThreadPool() {
+		stop();
+	}
+
+	// Start the given number of workers, with 0 every task runs immediately on the calling thread
+	void start(unsigned int threads) {
+		stop();
+		stopping = false;
+		for (unsigned int i = 0; i < threads; i++) {
+			workers.emplace_back(&ThreadPool::work, this);
+		}
+	}
+
+	// Finish the queued tasks and join the workers
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(tasksMutex);
+			stopping = true;
+		}
+		tasksAvailable.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+	}
+
+	size_t size() {
+		return workers.size();
+	}
+
+	// Queue a task, the future returns its result or rethrows its exception
+	template <typename F>
+	auto submit(F f) -> std::future<decltype(f())> {
+		auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+		std::future<decltype(f())> result = task->get_future();
+		if (workers.empty()) {
+			(*task)();
+			return result;
+		}
+		{
+			std::lock_guard<std::mutex> lock(tasksMutex);
+			tasks.push([task]() { (*task)(); });
+		}
+		tasksAvailable.notify_one();
+		return result;
+	}
+};
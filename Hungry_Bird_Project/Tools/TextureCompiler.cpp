@@ -0,0 +1,466 @@
+// Texture compiler: builds the mip chain of every PNG/JPEG and saves it block compressed next to the image
+// (image.png -> image.png.hbtx), the game loads it instead of the image when the GPU supports BC formats
+//
+// Build from the Hungry_Bird_Project folder and run it there (no Vulkan needed):
+//   g++ -O2 -std=c++17 -Iheaders -I. Tools/TextureCompiler.cpp -o TextureCompiler
+//   cl /O2 /std:c++17 /EHsc /Iheaders /I. Tools\TextureCompiler.cpp
+//
+// Usage:
+//   TextureCompiler [--format auto|bc1|bc7] [--min-psnr <dB>] [files or folders...]
+// Without paths it compiles every image under Assets/textures. With auto the opaque images use BC1
+// (8:1 against RGBA8) and the ones with transparency BC7 (4:1). Images whose first level would fall
+// below min-psnr (default 35 dB) get no container and keep loading from the image. Run it again after
+// changing an image.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include "TextureContainer.hpp"
+
+namespace fs = std::filesystem;
+
+struct Image {
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> rgba;
+};
+
+float srgbToLinear(uint8_t value) {
+	float c = value / 255.0f;
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+uint8_t linearToSrgb(float c) {
+	c = std::min(std::max(c, 0.0f), 1.0f);
+	c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+	return (uint8_t)(c * 255.0f + 0.5f);
+}
+
+// Half size level with a 2x2 box filter, the colors are averaged in linear space like the GPU blit of sRGB images
+Image downsample(const Image& source, const float* toLinear) {
+	Image level;
+	level.width = std::max(1u, source.width / 2);
+	level.height = std::max(1u, source.height / 2);
+	level.rgba.resize((size_t)level.width * level.height * 4);
+	for (uint32_t y = 0; y < level.height; y++) {
+		for (uint32_t x = 0; x < level.width; x++) {
+			float sum[4] = {};
+			for (uint32_t dy = 0; dy < 2; dy++) {
+				for (uint32_t dx = 0; dx < 2; dx++) {
+					uint32_t sx = std::min(x * 2 + dx, source.width - 1);
+					uint32_t sy = std::min(y * 2 + dy, source.height - 1);
+					const uint8_t* p = &source.rgba[((size_t)sy * source.width + sx) * 4];
+					for (int c = 0; c < 3; c++) {
+						sum[c] += toLinear[p[c]];
+					}
+					sum[3] += p[3];
+				}
+			}
+			uint8_t* q = &level.rgba[((size_t)y * level.width + x) * 4];
+			for (int c = 0; c < 3; c++) {
+				q[c] = linearToSrgb(sum[c] / 4.0f);
+			}
+			q[3] = (uint8_t)(sum[3] / 4.0f + 0.5f);
+		}
+	}
+	return level;
+}
+
+// The 4x4 pixels of a block, repeating the last row and column at the borders of the image
+void readBlock(const Image& image, uint32_t bx, uint32_t by, float block[16][4]) {
+	for (uint32_t i = 0; i < 16; i++) {
+		uint32_t x = std::min(bx * 4 + i % 4, image.width - 1);
+		uint32_t y = std::min(by * 4 + i / 4, image.height - 1);
+		const uint8_t* p = &image.rgba[((size_t)y * image.width + x) * 4];
+		for (int c = 0; c < 4; c++) {
+			block[i][c] = p[c];
+		}
+	}
+}
+
+// Endpoints of the segment that best fits the pixels: their principal axis, cut at the extreme projections
+void fitEndpoints(float block[16][4], int channels, float e0[4], float e1[4]) {
+	float mean[4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < channels; c++) {
+			mean[c] += block[i][c] / 16.0f;
+		}
+	}
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int a = 0; a < channels; a++) {
+			for (int b = 0; b < channels; b++) {
+				covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+			}
+		}
+	}
+	// Power iteration, starting from the diagonal of the bounding box
+	float axis[4] = {};
+	for (int c = 0; c < channels; c++) {
+		float low = 255, high = 0;
+		for (int i = 0; i < 16; i++) {
+			low = std::min(low, block[i][c]);
+			high = std::max(high, block[i][c]);
+		}
+		axis[c] = high - low;
+	}
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		float length = 0;
+		for (int a = 0; a < channels; a++) {
+			for (int b = 0; b < channels; b++) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length += next[a] * next[a];
+		}
+		if (length < 1e-12f) {
+			break;
+		}
+		length = std::sqrt(length);
+		for (int c = 0; c < channels; c++) {
+			axis[c] = next[c] / length;
+		}
+	}
+	float length = 0;
+	for (int c = 0; c < channels; c++) {
+		length += axis[c] * axis[c];
+	}
+	if (length < 1e-12f) {
+		// Flat block
+		for (int c = 0; c < channels; c++) {
+			e0[c] = e1[c] = mean[c];
+		}
+		return;
+	}
+	length = std::sqrt(length);
+	float tMin = 1e30f, tMax = -1e30f;
+	for (int i = 0; i < 16; i++) {
+		float t = 0;
+		for (int c = 0; c < channels; c++) {
+			t += (block[i][c] - mean[c]) * axis[c] / length;
+		}
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+	for (int c = 0; c < channels; c++) {
+		e0[c] = std::min(std::max(mean[c] + tMin * axis[c] / length, 0.0f), 255.0f);
+		e1[c] = std::min(std::max(mean[c] + tMax * axis[c] / length, 0.0f), 255.0f);
+	}
+}
+
+// Index of the palette entry closest to the pixel, error gets its squared distance
+int closest(const float pixel[4], const float palette[][4], int entries, int channels, float& error) {
+	int best = 0;
+	error = 1e30f;
+	for (int j = 0; j < entries; j++) {
+		float distance = 0;
+		for (int c = 0; c < channels; c++) {
+			float d = pixel[c] - palette[j][c];
+			distance += d * d;
+		}
+		if (distance < error) {
+			error = distance;
+			best = j;
+		}
+	}
+	return best;
+}
+
+uint16_t to565(const float color[4]) {
+	uint16_t r = (uint16_t)(color[0] * 31.0f / 255.0f + 0.5f);
+	uint16_t g = (uint16_t)(color[1] * 63.0f / 255.0f + 0.5f);
+	uint16_t b = (uint16_t)(color[2] * 31.0f / 255.0f + 0.5f);
+	return (r << 11) | (g << 5) | b;
+}
+
+void from565(uint16_t packed, float color[4]) {
+	uint32_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (float)((r << 3) | (r >> 2));
+	color[1] = (float)((g << 2) | (g >> 4));
+	color[2] = (float)((b << 3) | (b >> 2));
+	color[3] = 255;
+}
+
+// BC1 in four color mode: two 565 endpoints and 2 bit indices. Returns the squared error of the block
+float encodeBC1(float block[16][4], uint8_t out[8]) {
+	float e0[4], e1[4];
+	fitEndpoints(block, 3, e0, e1);
+	uint16_t c0 = to565(e1), c1 = to565(e0);
+	if (c0 < c1) {
+		std::swap(c0, c1);
+	}
+	uint32_t indices = 0;
+	float palette[4][4];
+	from565(c0, palette[0]);
+	from565(c1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3.0f;
+	}
+	float blockError = 0;
+	for (int i = 0; i < 16; i++) {
+		float error;
+		// With equal endpoints the block is in three color mode, where index 3 is black
+		indices |= (uint32_t)closest(block[i], palette, c0 != c1 ? 4 : 1, 3, error) << (i * 2);
+		blockError += error;
+	}
+	memcpy(out, &c0, 2);
+	memcpy(out + 2, &c1, 2);
+	memcpy(out + 4, &indices, 4);
+	return blockError;
+}
+
+// Writes the 128 bits of a BC7 block from the least significant bit
+struct BitWriter {
+	uint8_t* bytes;
+	uint32_t position = 0;
+
+	void write(uint32_t value, uint32_t bits) {
+		for (uint32_t i = 0; i < bits; i++, position++) {
+			if ((value >> i) & 1) {
+				bytes[position / 8] |= 1 << (position % 8);
+			}
+		}
+	}
+};
+
+// BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a p-bit each, 4 bit indices. Returns the squared error of the block
+float encodeBC7(float block[16][4], uint8_t out[16]) {
+	static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	float fitted[2][4];
+	fitEndpoints(block, 4, fitted[0], fitted[1]);
+
+	// Quantize every endpoint with the p-bit that gets closer to it
+	uint32_t q[2][4], p[2];
+	float endpoints[2][4];
+	for (int e = 0; e < 2; e++) {
+		float bestError = 1e30f;
+		for (uint32_t bit = 0; bit < 2; bit++) {
+			uint32_t candidate[4];
+			float error = 0;
+			for (int c = 0; c < 4; c++) {
+				int value = (int)std::lround((fitted[e][c] - bit) / 2.0f);
+				candidate[c] = (uint32_t)std::min(std::max(value, 0), 127);
+				float d = fitted[e][c] - (float)((candidate[c] << 1) | bit);
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				p[e] = bit;
+				memcpy(q[e], candidate, sizeof(candidate));
+			}
+		}
+		for (int c = 0; c < 4; c++) {
+			endpoints[e][c] = (float)((q[e][c] << 1) | p[e]);
+		}
+	}
+
+	float palette[16][4];
+	for (int j = 0; j < 16; j++) {
+		for (int c = 0; c < 4; c++) {
+			palette[j][c] = (float)((((64 - weights[j]) * (int)endpoints[0][c] + weights[j] * (int)endpoints[1][c]) + 32) >> 6);
+		}
+	}
+	int indices[16];
+	float blockError = 0;
+	for (int i = 0; i < 16; i++) {
+		float error;
+		indices[i] = closest(block[i], palette, 16, 4, error);
+		blockError += error;
+	}
+	// The most significant bit of the first index is not stored and must be 0
+	if (indices[0] >= 8) {
+		std::swap(q[0], q[1]);
+		std::swap(p[0], p[1]);
+		for (int i = 0; i < 16; i++) {
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	memset(out, 0, 16);
+	BitWriter writer{ out };
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.write(q[0][c], 7);
+		writer.write(q[1][c], 7);
+	}
+	writer.write(p[0], 1);
+	writer.write(p[1], 1);
+	writer.write(indices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		writer.write(indices[i], 4);
+	}
+	return blockError;
+}
+
+// Blocks of the level, psnr gets the quality of the compressed pixels
+std::vector<uint8_t> encodeLevel(const Image& image, uint32_t format, double& psnr) {
+	uint32_t blocksX = (image.width + 3) / 4, blocksY = (image.height + 3) / 4;
+	uint32_t blockBytes = textureBlockBytes(format);
+	std::vector<uint8_t> blocks((size_t)blocksX * blocksY * blockBytes);
+	float block[16][4];
+	double error = 0;
+	for (uint32_t by = 0; by < blocksY; by++) {
+		for (uint32_t bx = 0; bx < blocksX; bx++) {
+			readBlock(image, bx, by, block);
+			uint8_t* out = &blocks[((size_t)by * blocksX + bx) * blockBytes];
+			// The error of the border blocks also counts the repeated pixels, close enough for a threshold
+			error += format == TEXTURE_FORMAT_BC1 ? encodeBC1(block, out) : encodeBC7(block, out);
+		}
+	}
+	double meanError = error / ((double)blocksX * blocksY * 16 * (format == TEXTURE_FORMAT_BC1 ? 3 : 4));
+	psnr = meanError > 0 ? 10.0 * std::log10(255.0 * 255.0 / meanError) : 99.0;
+	return blocks;
+}
+
+// Compile one image, returns the size of the container or 0 if the image is left uncompressed
+uint64_t compile(const fs::path& source, const std::string& formatOption, double minPsnr, const float* toLinear) {
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(source.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels) {
+		throw std::runtime_error("failed to load " + source.string() + "!");
+	}
+	Image image;
+	image.width = width;
+	image.height = height;
+	image.rgba.assign(pixels, pixels + (size_t)width * height * 4);
+	stbi_image_free(pixels);
+
+	bool opaque = true;
+	for (size_t i = 3; i < image.rgba.size(); i += 4) {
+		opaque = opaque && image.rgba[i] == 255;
+	}
+	uint32_t format = formatOption == "bc1" || (formatOption == "auto" && opaque) ? TEXTURE_FORMAT_BC1 : TEXTURE_FORMAT_BC7;
+	if (format == TEXTURE_FORMAT_BC1 && !opaque) {
+		std::cout << "warning: BC1 drops the transparency of " << source.string() << "\n";
+	}
+
+	TextureContainerHeader header{};
+	header.magic = TEXTURE_CONTAINER_MAGIC;
+	header.version = TEXTURE_CONTAINER_VERSION;
+	header.format = format;
+	// The same number of levels the runtime generates from the image
+	header.mipLevels = std::min<uint32_t>(TEXTURE_CONTAINER_MAX_LEVELS,
+		static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1);
+	if (!MeshCache::sourceInfo(source.string(), header.sourceSize, header.sourceTime)) {
+		throw std::runtime_error("failed to read the size of " + source.string() + "!");
+	}
+
+	std::string path = source.string() + TEXTURE_CONTAINER_EXTENSION;
+	std::vector<std::vector<uint8_t>> levels;
+	uint64_t offset = (sizeof(header) + 15) & ~(uint64_t)15;
+	for (uint32_t i = 0; i < header.mipLevels; i++) {
+		if (i > 0) {
+			image = downsample(image, toLinear);
+		}
+		double psnr;
+		levels.push_back(encodeLevel(image, format, psnr));
+		// Palette textures, where every texel is a different material, do not survive the block compression
+		if (i == 0 && psnr < minPsnr) {
+			std::cout << "     PNG  " << std::fixed << std::setprecision(2) << psnr << " dB with "
+					  << (format == TEXTURE_FORMAT_BC1 ? "BC1" : "BC7") << ", left uncompressed  " << source.string() << "\n";
+			std::error_code error;
+			fs::remove(path, error);
+			return 0;
+		}
+		header.levels[i] = { image.width, image.height, offset, levels.back().size() };
+		offset = (offset + levels.back().size() + 15) & ~(uint64_t)15;
+	}
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out.is_open()) {
+		throw std::runtime_error("failed to write " + path + "!");
+	}
+	const char padding[16] = {};
+	out.write((const char*)&header, sizeof(header));
+	uint64_t written = sizeof(header);
+	for (uint32_t i = 0; i < header.mipLevels; i++) {
+		out.write(padding, header.levels[i].offset - written);
+		out.write((const char*)levels[i].data(), levels[i].size());
+		written = header.levels[i].offset + levels[i].size();
+	}
+
+	uint64_t rgbaSize = 0;
+	for (uint32_t i = 0; i < header.mipLevels; i++) {
+		rgbaSize += (uint64_t)header.levels[i].width * header.levels[i].height * 4;
+	}
+	std::cout << std::setw(8) << (format == TEXTURE_FORMAT_BC1 ? "BC1" : "BC7") << std::setw(6) << width << "x" << std::left
+			  << std::setw(6) << height << std::right << std::setw(4) << header.mipLevels << " mips "
+			  << std::fixed << std::setprecision(2) << std::setw(9) << written / 1048576.0 << " MB ("
+			  << (double)rgbaSize / written << ":1)  " << path << "\n";
+	return written;
+}
+
+bool isImage(const fs::path& path) {
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".png" || extension == ".jpg" || extension == ".jpeg";
+}
+
+int main(int argc, char* argv[]) {
+	std::string format = "auto";
+	double minPsnr = 35.0;
+	std::vector<fs::path> inputs;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--format" && i + 1 < argc) {
+			format = argv[++i];
+			if (format != "auto" && format != "bc1" && format != "bc7") {
+				std::cerr << "unknown format " << format << "\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg == "--min-psnr" && i + 1 < argc) {
+			minPsnr = std::stod(argv[++i]);
+		}
+		else {
+			inputs.push_back(arg);
+		}
+	}
+	if (inputs.empty()) {
+		inputs.push_back("Assets/textures");
+	}
+
+	std::vector<fs::path> images;
+	for (const fs::path& input : inputs) {
+		if (fs::is_directory(input)) {
+			for (const auto& entry : fs::recursive_directory_iterator(input)) {
+				if (entry.is_regular_file() && isImage(entry.path())) {
+					images.push_back(entry.path());
+				}
+			}
+		} else {
+			images.push_back(input);
+		}
+	}
+	std::sort(images.begin(), images.end());
+
+	float toLinear[256];
+	for (int i = 0; i < 256; i++) {
+		toLinear[i] = srgbToLinear((uint8_t)i);
+	}
+
+	try {
+		uint64_t total = 0;
+		for (const fs::path& image : images) {
+			total += compile(image, format, minPsnr, toLinear);
+		}
+		std::cout << images.size() << " textures, " << std::fixed << std::setprecision(2) << total / 1048576.0 << " MB\n";
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
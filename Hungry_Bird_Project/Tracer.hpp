@@ -0,0 +1,171 @@
+// CPU tracer: scoped zones saved as a Chrome trace-event file (open it in chrome://tracing or ui.perfetto.dev)
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+
+// Put TRACE_ZONE("name") at the beginning of a scope to measure it, the name must be a string literal
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone_, __LINE__)(name)
+
+struct TraceEvent {
+	const char* name;
+	int64_t startNs;
+	int64_t durationNs;
+};
+
+// Every thread writes into its own buffer without locking. It grows with the events of the thread up to
+// capacity, so the loading threads that record a few zones stay small; then the oldest events are overwritten
+struct TraceBuffer {
+	std::vector<TraceEvent> events;
+	size_t capacity = 0;
+	size_t next = 0;
+	bool wrapped = false;
+	uint32_t threadId;
+
+	void push(const TraceEvent& event) {
+		if (events.size() < capacity) {
+			events.push_back(event);
+			return;
+		}
+		events[next] = event;
+		next++;
+		wrapped = true;
+		if (next == events.size()) {
+			next = 0;
+		}
+	}
+};
+
+class Tracer
+{
+protected:
+	Tracer() : startTime(std::chrono::steady_clock::now())
+	{}
+
+	// Read by every thread that opens a zone
+	std::atomic<bool> enabled{ false };
+	std::string outputFile;
+	size_t eventsPerThread = 0;
+	std::chrono::steady_clock::time_point startTime;
+
+	std::mutex buffersMutex;
+	std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+	TraceBuffer* registerThread() {
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		buffers.push_back(std::make_unique<TraceBuffer>());
+		TraceBuffer* buffer = buffers.back().get();
+		buffer->capacity = eventsPerThread;
+		buffer->threadId = buffers.size();
+		return buffer;
+	}
+
+public:
+
+	Tracer(Tracer& other) = delete;
+
+	void operator=(const Tracer&) = delete;
+
+	static Tracer* GetInstance();
+
+	// Start collecting events, keeping at most eventsPerThread of them for each thread
+	void start(std::string file, size_t capacity = 1 << 20) {
+		outputFile = file;
+		eventsPerThread = capacity;
+		enabled = true;
+	}
+
+	bool isEnabled() {
+		return enabled;
+	}
+
+	int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - startTime).count();
+	}
+
+	void record(const char* name, int64_t startNs, int64_t endNs) {
+		thread_local TraceBuffer* buffer = nullptr;
+		if (buffer == nullptr) {
+			buffer = registerThread();
+		}
+		buffer->push({ name, startNs, endNs - startNs });
+	}
+
+	// Stop collecting and write the trace, the other threads must not be recording anymore
+	void save() {
+		if (!enabled) {
+			return;
+		}
+		enabled = false;
+
+		std::ofstream file(outputFile);
+		if (!file.is_open()) {
+			std::cout << "failed to write the trace to " << outputFile << "\n";
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		size_t count = 0;
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		for (auto const& buffer : buffers) {
+			size_t size = buffer->events.size();
+			size_t first = buffer->wrapped ? buffer->next : 0;
+			for (size_t i = 0; i < size; i++) {
+				const TraceEvent& event = buffer->events[(first + i) % buffer->events.size()];
+				// Chrome wants microseconds, keep the fractional part to see the short zones
+				file << (count == 0 ? "" : ",\n")
+					 << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+					 << ",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0 << "}";
+				count++;
+			}
+		}
+		file << "\n]}\n";
+		std::cout << "Trace of " << count << " events saved to " << outputFile << "\n";
+	}
+};
+Tracer* Tracer::GetInstance()
+{
+	// Used also by the loading threads: the local static is created only once
+	static Tracer* singleton_ = new Tracer();
+	return singleton_;
+}
+
+// Records the time between its construction and its destruction
+class TraceZone {
+	const char* name;
+	int64_t startNs = -1;
+
+public:
+	TraceZone(const char* zoneName) : name(zoneName) {
+		if (Tracer::GetInstance()->isEnabled()) {
+			startNs = Tracer::GetInstance()->now();
+		}
+	}
+
+	// End the zone before the end of the scope
+	void stop() {
+		if (startNs >= 0 && Tracer::GetInstance()->isEnabled()) {
+			Tracer::GetInstance()->record(name, startNs, Tracer::GetInstance()->now());
+		}
+		startNs = -1;
+	}
+
+	~TraceZone() {
+		stop();
+	}
+
+	TraceZone(const TraceZone&) = delete;
+	void operator=(const TraceZone&) = delete;
+};
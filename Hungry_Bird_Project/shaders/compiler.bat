@@ -1,5 +1,6 @@
 %VULKAN_SDK%/Bin/glslc.exe materialShader.frag -o materialFrag.spv
 %VULKAN_SDK%/Bin/glslc.exe materialShader.vert -o materialVert.spv
+%VULKAN_SDK%/Bin/glslc.exe materialCompactShader.vert -o materialCompactVert.spv
 %VULKAN_SDK%/Bin/glslc.exe skyBoxShader.frag -o skyBoxFrag.spv
 %VULKAN_SDK%/Bin/glslc.exe skyBoxShader.vert -o skyBoxVert.spv
 %VULKAN_SDK%/Bin/glslc.exe TextShader.frag -o TextFrag.spv
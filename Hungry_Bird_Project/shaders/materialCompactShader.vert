@@ -0,0 +1,41 @@
+#version 450
+
+layout(set=0, binding = 0) uniform GlobalUniformBufferObject {
+	mat4 view;
+	mat4 proj;
+} gubo;
+
+layout(set=1, binding = 0) uniform UniformBufferObject {
+	mat4 model;
+} ubo;
+
+// Box of the mesh: position = offset + pos * scale
+layout(push_constant) uniform MeshQuantization {
+	vec4 offset;
+	vec4 scale;
+} mesh;
+
+layout(location = 0) in vec4 pos;
+layout(location = 1) in vec2 norm;
+layout(location = 2) in vec2 texCoord;
+
+layout(location = 0) out vec3 fragViewDir;
+layout(location = 1) out vec3 fragNorm;
+layout(location = 2) out vec2 fragTexCoord;
+
+// Unfold the octahedral encoding of CompactVertex::encode
+vec3 decodeNormal(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main() {
+	vec3 position = mesh.offset.xyz + pos.xyz * mesh.scale.xyz;
+	gl_Position = gubo.proj * gubo.view * ubo.model * vec4(position, 1.0);
+	fragViewDir  = (gubo.view[3]).xyz - (ubo.model * vec4(position,  1.0)).xyz;
+	fragNorm     = (ubo.model * vec4(decodeNormal(norm), 0.0)).xyz;
+	fragTexCoord = texCoord;
+}